@@ -0,0 +1,309 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+// Benchmarks of the accumulate, render, text and encode stages
+// Usage: plotz_bench [filter] [--min-time seconds] [--csv results.csv] [--baseline results.csv] [--tolerance 0.1]
+// Only benchmarks whose name contains filter run. With --baseline the run fails (exit code 1) when any benchmark
+// is slower than the baseline by more than the tolerance, so upgrades can be gated on a saved earlier run.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "plotz/plotz.hpp"
+
+namespace
+{
+   // Keeps the compiler from discarding results it can prove unused
+   template <class T>
+   void do_not_optimize(const T& value)
+   {
+#if defined(__GNUC__) || defined(__clang__)
+      asm volatile("" : : "g"(&value) : "memory");
+#else
+      static volatile const void* sink;
+      sink = &value;
+#endif
+   }
+
+   struct bench_result final
+   {
+      std::string name;
+      double seconds_per_op{};
+      double items_per_second{};
+      std::string unit;
+   };
+
+   struct bench_runner final
+   {
+      std::string filter;
+      double min_time = 0.25; // Seconds each benchmark runs for at least
+      std::vector<bench_result> results;
+
+      // Times f, which processes `items` units (points, pixels, ...) per call
+      template <class F>
+      void run(const std::string& name, double items, const std::string& unit, F&& f)
+      {
+         if (!filter.empty() && name.find(filter) == std::string::npos) return;
+
+         using clock = std::chrono::steady_clock;
+         f(); // Warm caches, glyph caches and lazily built tables
+         size_t iterations = 1;
+         double elapsed = 0.0;
+         while (true) {
+            const auto start = clock::now();
+            for (size_t i = 0; i < iterations; ++i) f();
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+            if (elapsed >= min_time || iterations >= (size_t(1) << 30)) break;
+            const double growth = elapsed > 0.0 ? 1.2 * min_time / elapsed : 100.0;
+            iterations = size_t(double(iterations) * std::clamp(growth, 2.0, 100.0));
+         }
+
+         const double per_op = elapsed / double(iterations);
+         const bench_result& r = results.emplace_back(bench_result{name, per_op, items / per_op, unit});
+         std::cout << std::format("{:<44} {:>12.3f} us {:>12.2f} M{}/s\n", r.name, r.seconds_per_op * 1e6,
+                                  r.items_per_second * 1e-6, r.unit);
+      }
+   };
+
+   std::vector<plotz::point> random_points(uint32_t w, uint32_t h, size_t n)
+   {
+      std::mt19937 prng(42);
+      std::vector<plotz::point> points(n);
+      for (auto& p : points) p = {uint32_t(prng() % w), uint32_t(prng() % h)};
+      return points;
+   }
+
+   void bench_accumulate(bench_runner& bench)
+   {
+      static constexpr uint32_t w = 2048, h = 2048;
+      static constexpr size_t n = 10000;
+      const auto points = random_points(w, h, n);
+      plotz::heatmap hm(w, h);
+
+      bench.run("heatmap/add_point/fixed_r4", n, "points", [&] {
+         for (const auto& p : points) hm.add_point(p.x, p.y);
+      });
+
+      for (const uint32_t radius : {4u, 8u, 16u, 32u}) {
+         const auto& stamp = plotz::cached_stamp(radius);
+         bench.run(std::format("heatmap/add_point_with_stamp/r{}", radius), n, "points", [&] {
+            for (const auto& p : points) hm.add_point_with_stamp(p.x, p.y, stamp);
+         });
+      }
+
+      bench.run("heatmap/add_points/fixed_r4", n, "points", [&] { hm.add_points(points); });
+      bench.run("heatmap/add_points_parallel/fixed_r4", n, "points", [&] { hm.add_points_parallel(points); });
+
+      plotz::basic_heatmap<uint16_t> hm16(w, h);
+      bench.run("heatmap_u16/add_points/fixed_r4", n, "points", [&] { hm16.add_points(points); });
+      do_not_optimize(hm.buffer.data());
+      do_not_optimize(hm16.buffer.data());
+   }
+
+   void bench_render(bench_runner& bench)
+   {
+      for (const uint32_t size : {1024u, 4096u}) {
+         const double pixels = double(size) * size;
+         plotz::image out(size, size);
+
+         plotz::heatmap hm(size, size);
+         hm.add_points(random_points(size, size, 10000));
+         const plotz::palette colors(plotz::default_color_scheme);
+         bench.run(std::format("heatmap/render_saturated/{}", size), pixels, "pixels", [&] {
+            hm.render_saturated_into(out.view(), colors, hm.current_max_heat());
+            do_not_optimize(out.data.data());
+         });
+         bench.run(std::format("heatmap/render_saturated_parallel/{}", size), pixels, "pixels", [&] {
+            hm.render_saturated_into(out.view(), colors, hm.current_max_heat(), 0);
+            do_not_optimize(out.data.data());
+         });
+
+         plotz::magnitude mag(size, size);
+         for (uint32_t y = 0; y < size; ++y) {
+            for (uint32_t x = 0; x < size; ++x) mag.add_point(x, y, float(x + y) / float(2 * size));
+         }
+         bench.run(std::format("magnitude/render_saturated/{}", size), pixels, "pixels", [&] {
+            mag.render_saturated_into(out.view(), colors, mag.max_magnitude);
+            do_not_optimize(out.data.data());
+         });
+      }
+   }
+
+   void bench_mapped(bench_runner& bench)
+   {
+      struct mapped_case final
+      {
+         const char* name;
+         uint32_t input_w, input_h, image_w, image_h;
+      };
+      for (const auto& c : {mapped_case{"grow", 100, 100, 2048, 2048}, mapped_case{"shrink", 2048, 2048, 512, 512}}) {
+         plotz::magnitude_mapped plot(c.input_w, c.input_h, c.image_w, c.image_h);
+         const double inputs = double(c.input_w) * c.input_h;
+         bench.run(std::format("magnitude_mapped/{}/add_point", c.name), inputs, "inputs", [&] {
+            for (uint32_t y = 0; y < c.input_h; ++y) {
+               for (uint32_t x = 0; x < c.input_w; ++x) plot.add_point(x, y, float(x + y));
+            }
+            do_not_optimize(plot.buffer.data());
+         });
+
+         std::vector<float> grid(size_t(c.input_w) * c.input_h);
+         for (size_t i = 0; i < grid.size(); ++i) grid[i] = float(i % 977);
+         bench.run(std::format("magnitude_mapped/{}/set_grid", c.name), inputs, "inputs", [&] {
+            plot.set_grid(grid);
+            do_not_optimize(plot.buffer.data());
+         });
+         bench.run(std::format("magnitude_mapped/{}/set_grid_parallel", c.name), inputs, "inputs", [&] {
+            plot.set_grid(grid, plotz::resample::mean, 0);
+            do_not_optimize(plot.buffer.data());
+         });
+
+         plotz::image out(c.image_w, c.image_h);
+         bench.run(std::format("magnitude_mapped/{}/render", c.name), double(c.image_w) * c.image_h, "pixels", [&] {
+            plot.render_into(out.view());
+            do_not_optimize(out.data.data());
+         });
+      }
+   }
+
+   void bench_text(bench_runner& bench)
+   {
+      const std::string font = FONTS_DIR "/RobotoMono-SemiBold.ttf";
+      const std::string text = "Sample Magnitude Plot 0123456789";
+      for (const uint32_t size : {512u, 2048u}) {
+         plotz::image out(size, size);
+         bench.run(std::format("text/render_text_to_image/{}", size), double(text.size()), "glyphs", [&] {
+            plotz::render_text_to_image(out.view(), text, font, 3.0f, {255, 255, 255, 255});
+            do_not_optimize(out.data.data());
+         });
+      }
+   }
+
+   void bench_encode(bench_runner& bench)
+   {
+      for (const uint32_t size : {256u, 1024u, 2048u}) {
+         plotz::magnitude mag(size, size);
+         for (uint32_t y = 0; y < size; ++y) {
+            for (uint32_t x = 0; x < size; ++x) mag.add_point(x, y, std::sin(float(x) * 0.01f) + float(y) / size);
+         }
+         plotz::image img(size, size);
+         mag.render_into(img.view());
+         const double pixels = double(size) * size;
+
+         plotz::memory_sink sink;
+         bench.run(std::format("encode/write_png/{}", size), pixels, "pixels", [&] {
+            sink.clear();
+            plotz::write_png(sink, img.view());
+         });
+         bench.run(std::format("encode/write_png_fast/{}", size), pixels, "pixels", [&] {
+            sink.clear();
+            plotz::write_png(sink, img.view(), {.compression_level = 1, .filters = PNG_FILTER_SUB});
+         });
+         bench.run(std::format("encode/write_png_parallel/{}", size), pixels, "pixels", [&] {
+            sink.clear();
+            plotz::write_png_parallel(sink, img.view());
+         });
+         bench.run(std::format("encode/qoi/{}", size), pixels, "pixels", [&] {
+            sink.clear();
+            plotz::write_image(sink, img.view(), plotz::image_format::qoi);
+         });
+      }
+   }
+
+   void write_csv(const std::string& filename, const std::vector<bench_result>& results)
+   {
+      std::ofstream out(filename);
+      if (!out) throw std::runtime_error(std::format("Error writing {}", filename));
+      out << "name,seconds_per_op,items_per_second,unit\n";
+      for (const auto& r : results) {
+         out << std::format("{},{:.9g},{:.9g},{}\n", r.name, r.seconds_per_op, r.items_per_second, r.unit);
+      }
+   }
+
+   // Name to seconds per op
+   std::map<std::string, double> read_csv(const std::string& filename)
+   {
+      std::ifstream in(filename);
+      if (!in) throw std::runtime_error(std::format("Error reading {}", filename));
+      std::map<std::string, double> baseline;
+      std::string line;
+      std::getline(in, line); // Header
+      while (std::getline(in, line)) {
+         std::istringstream fields(line);
+         std::string name, seconds;
+         if (std::getline(fields, name, ',') && std::getline(fields, seconds, ',')) {
+            baseline[name] = std::stod(seconds);
+         }
+      }
+      return baseline;
+   }
+
+   // Returns the number of benchmarks slower than the baseline by more than tolerance
+   size_t compare(const std::vector<bench_result>& results, const std::map<std::string, double>& baseline,
+                  double tolerance)
+   {
+      size_t regressions = 0;
+      for (const auto& r : results) {
+         const auto it = baseline.find(r.name);
+         if (it == baseline.end()) continue;
+         const double change = r.seconds_per_op / it->second - 1.0;
+         if (change > tolerance) {
+            ++regressions;
+            std::cout << std::format("REGRESSION {:<44} {:+.1f}%\n", r.name, change * 100.0);
+         }
+      }
+      return regressions;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   bench_runner bench;
+   std::string csv_file, baseline_file;
+   double tolerance = 0.1;
+   for (int i = 1; i < argc; ++i) {
+      const std::string arg = argv[i];
+      auto value = [&] {
+         if (i + 1 >= argc) {
+            std::cerr << std::format("Missing value for {}\n", arg);
+            std::exit(2);
+         }
+         return std::string(argv[++i]);
+      };
+      if (arg == "--min-time") bench.min_time = std::stod(value());
+      else if (arg == "--csv") csv_file = value();
+      else if (arg == "--baseline") baseline_file = value();
+      else if (arg == "--tolerance") tolerance = std::stod(value());
+      else if (arg == "--help" || arg == "-h") {
+         std::cout << "plotz_bench [filter] [--min-time seconds] [--csv out.csv] [--baseline in.csv] "
+                      "[--tolerance fraction]\n";
+         return 0;
+      }
+      else bench.filter = arg;
+   }
+
+   try {
+      bench_accumulate(bench);
+      bench_render(bench);
+      bench_mapped(bench);
+      bench_text(bench);
+      bench_encode(bench);
+
+      if (!csv_file.empty()) write_csv(csv_file, bench.results);
+      if (!baseline_file.empty() && compare(bench.results, read_csv(baseline_file), tolerance) > 0) return 1;
+   }
+   catch (const std::exception& e) {
+      std::cerr << e.what() << '\n';
+      return 2;
+   }
+}
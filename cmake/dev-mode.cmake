@@ -28,3 +28,14 @@ set_target_properties(${PROJECT_NAME}_${PROJECT_NAME} ${PROJECT_NAME}_ide PROPER
 target_compile_definitions(${PROJECT_NAME}_ide PRIVATE 
     FONTS_DIR=\"${CMAKE_CURRENT_SOURCE_DIR}/fonts\"
 )
+
+# Benchmarks of the accumulate, render, text and encode stages, see bench/bench.cpp for the options
+add_executable(${PROJECT_NAME}_bench "${PROJECT_SOURCE_DIR}/bench/bench.cpp" ${headers})
+
+target_link_libraries(${PROJECT_NAME}_bench PRIVATE ${PROJECT_NAME}::${PROJECT_NAME})
+
+set_target_properties(${PROJECT_NAME}_bench PROPERTIES FOLDER ProjectTargets)
+
+target_compile_definitions(${PROJECT_NAME}_bench PRIVATE
+    FONTS_DIR=\"${CMAKE_CURRENT_SOURCE_DIR}/fonts\"
+)
@@ -0,0 +1,52 @@
+# ---- Embedded fonts ----
+
+# Converts every font in fonts/ into a byte array in plotz/embedded_fonts.hpp, so they can be registered from
+# memory without any file I/O at runtime. Each font is registered under its file stem, e.g. "RobotoMono-SemiBold".
+
+set(embedded_fonts_header "${PROJECT_BINARY_DIR}/include/plotz/embedded_fonts.hpp")
+file(GLOB embedded_font_files CONFIGURE_DEPENDS "${PROJECT_SOURCE_DIR}/fonts/*.ttf")
+
+set(embedded_font_arrays "")
+set(embedded_font_entries "")
+foreach(font_file IN LISTS embedded_font_files)
+  get_filename_component(font_name "${font_file}" NAME_WE)
+  string(MAKE_C_IDENTIFIER "${font_name}" font_identifier)
+  string(TOLOWER "${font_identifier}" font_identifier)
+
+  file(READ "${font_file}" font_hex HEX)
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," font_bytes "${font_hex}")
+
+  string(APPEND embedded_font_arrays "   inline constexpr uint8_t ${font_identifier}[] = {${font_bytes}};\n")
+  string(APPEND embedded_font_entries "      {\"${font_name}\", ${font_identifier}, sizeof(${font_identifier})},\n")
+endforeach()
+
+file(CONFIGURE OUTPUT "${embedded_fonts_header}" CONTENT [[
+// Plotz Library
+// For the license information refer to plotz.hpp
+// Generated by cmake/embed-fonts.cmake, do not edit
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace plotz::embedded_fonts
+{
+@embedded_font_arrays@
+   struct embedded_font final
+   {
+      const char* name;
+      const uint8_t* data;
+      size_t size;
+   };
+
+   inline constexpr embedded_font fonts[] = {
+@embedded_font_entries@   };
+}
+]] @ONLY)
+
+target_include_directories(
+    ${PROJECT_NAME}_${PROJECT_NAME} ${warning_guard}
+    INTERFACE "$<BUILD_INTERFACE:${PROJECT_BINARY_DIR}/include>"
+)
+target_compile_definitions(${PROJECT_NAME}_${PROJECT_NAME} INTERFACE PLOTZ_EMBEDDED_FONTS)
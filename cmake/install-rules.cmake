@@ -17,6 +17,14 @@ install(
     COMPONENT ${PROJECT_NAME}_Development
 )
 
+if(${PROJECT_NAME}_EMBED_FONTS)
+  install(
+      FILES "${PROJECT_BINARY_DIR}/include/plotz/embedded_fonts.hpp"
+      DESTINATION "${CMAKE_INSTALL_INCLUDEDIR}/plotz"
+      COMPONENT ${PROJECT_NAME}_Development
+  )
+endif()
+
 install(
     TARGETS ${PROJECT_NAME}_${PROJECT_NAME}
     EXPORT ${PROJECT_NAME}Targets
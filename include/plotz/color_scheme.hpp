@@ -3,9 +3,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <vector>
 
+#include "plotz/memo_cache.hpp"
+
 namespace plotz
 {
    using rgba = std::array<uint8_t, 4>;
@@ -14,7 +20,7 @@ namespace plotz
    inline constexpr rgba black{0, 0, 0, 255};
 
    // colors must be allocated with a length of steps * 4
-   inline void interpolate_color(uint8_t* colors, const rgba& c1, const rgba& c2, int steps) noexcept
+   constexpr void interpolate_color(uint8_t* colors, const rgba& c1, const rgba& c2, int steps) noexcept
    {
       for (int i = 0; i < steps; ++i) {
          float ratio = float(i) / (steps - 1);
@@ -28,7 +34,7 @@ namespace plotz
       }
    }
 
-   inline std::vector<uint8_t> make_color_scheme(const std::vector<rgba>& key_colors, int steps_between_keys = 128)
+   inline std::vector<uint8_t> make_color_scheme(std::span<const rgba> key_colors, int steps_between_keys = 128)
    {
       if (key_colors.size() < 2) {
          // Not enough key colors to interpolate
@@ -55,8 +61,38 @@ namespace plotz
       return data;
    }
 
-   // Define key colors for the rainbow
-   inline const std::vector<rgba> raindbow_key_colors{
+   // Compile time make_color_scheme, the result lives in read only data with no startup cost
+   template <size_t Steps = 128, size_t Keys>
+      requires(Keys >= 2 && Steps >= 2)
+   constexpr auto make_fixed_color_scheme(const std::array<rgba, Keys>& key_colors)
+   {
+      std::array<uint8_t, (Keys - 1) * Steps * 4> data{};
+      for (size_t i = 0; i + 1 < Keys; ++i) {
+         interpolate_color(data.data() + i * Steps * 4, key_colors[i], key_colors[i + 1], int(Steps));
+      }
+      return data;
+   }
+
+   // Scheme of exactly `colors` entries spread evenly across the key colors, e.g. 256 for byte indexed lookup
+   inline std::vector<uint8_t> make_color_scheme_sized(std::span<const rgba> key_colors, size_t colors)
+   {
+      if (key_colors.size() < 2 || colors == 0) return {};
+
+      const size_t num_segments = key_colors.size() - 1;
+      std::vector<uint8_t> data(colors * 4);
+      for (size_t i = 0; i < colors; ++i) {
+         const float pos = colors > 1 ? float(i) * num_segments / float(colors - 1) : 0.0f;
+         const size_t segment = (std::min)(size_t(pos), num_segments - 1);
+         const float ratio = pos - float(segment);
+         const auto& c1 = key_colors[segment];
+         const auto& c2 = key_colors[segment + 1];
+         for (size_t c = 0; c < 4; ++c) data[i * 4 + c] = uint8_t(c1[c] + ratio * (c2[c] - c1[c]));
+      }
+      return data;
+   }
+
+   // Key colors of the built in schemes, usable in constant expressions
+   inline constexpr std::array<rgba, 7> rainbow_keys{{
       {148, 0, 211, 255}, // Violet
       {75, 0, 130, 255}, // Indigo
       {0, 0, 255, 255}, // Blue
@@ -64,9 +100,9 @@ namespace plotz
       {255, 255, 0, 255}, // Yellow
       {255, 127, 0, 255}, // Orange
       {255, 0, 0, 255} // Red
-   };
+   }};
 
-   inline const std::vector<rgba> viridis_key_colors{
+   inline constexpr std::array<rgba, 7> viridis_keys{{
       {68, 1, 84, 255}, // Dark Purple
       {72, 35, 116, 255}, // Purple
       {64, 67, 135, 255}, // Blue
@@ -74,18 +110,18 @@ namespace plotz
       {33, 145, 140, 255}, // Green
       {94, 201, 98, 255}, // Yellow-Green
       {253, 231, 37, 255} // Yellow
-   };
+   }};
 
-   inline const std::vector<rgba> jet_key_colors{
+   inline constexpr std::array<rgba, 6> jet_keys{{
       {0, 0, 131, 255}, // Dark Blue
       {0, 60, 170, 255}, // Blue
       {5, 255, 255, 255}, // Cyan
       {255, 255, 0, 255}, // Yellow
       {250, 0, 0, 255}, // Red
       {128, 0, 0, 255} // Dark Red
-   };
+   }};
 
-   inline const std::vector<rgba> soft_key_colors{
+   inline constexpr std::array<rgba, 7> soft_keys{{
       {30, 30, 150, 255}, // Dark Blue
       {50, 50, 200, 255}, // Blue
       {50, 120, 220, 255}, // Blue-Grey
@@ -93,9 +129,9 @@ namespace plotz
       {220, 140, 80, 255}, // Brownish Orange
       {200, 80, 80, 255}, // Dark Red
       {150, 50, 50, 255} // Very Dark Red
-   };
+   }};
 
-   inline const std::vector<rgba> inferno_key_colors{
+   inline constexpr std::array<rgba, 7> inferno_keys{{
       {0, 0, 4, 255}, // Very Dark Purple
       {68, 1, 84, 255}, // Dark Purple
       {148, 64, 161, 255}, // Purple
@@ -103,9 +139,9 @@ namespace plotz
       {253, 181, 98, 255}, // Orange
       {253, 231, 37, 255}, // Yellow
       {252, 255, 164, 255} // Light Yellow
-   };
+   }};
 
-   inline const std::vector<rgba> turbo_key_colors{
+   inline constexpr std::array<rgba, 7> turbo_keys{{
       {48, 18, 59, 255}, // Dark Purple
       {49, 54, 149, 255}, // Blue
       {33, 113, 181, 255}, // Blue-Green
@@ -113,9 +149,9 @@ namespace plotz
       {253, 231, 37, 255}, // Yellow
       {224, 163, 0, 255}, // Orange
       {136, 0, 0, 255} // Dark Red
-   };
+   }};
 
-   inline const std::vector<rgba> pastel_key_colors{
+   inline constexpr std::array<rgba, 7> pastel_keys{{
       {151, 136, 157, 255}, // Pastel Purple
       {152, 154, 202, 255}, // Pastel Blue
       {144, 184, 218, 255}, // Pastel Blue-Green
@@ -123,15 +159,109 @@ namespace plotz
       {254, 243, 146, 255}, // Pastel Yellow
       {239, 209, 128, 255}, // Pastel Orange
       {195, 127, 127, 255} // Pastel Red
-   };
+   }};
 
-   inline const std::vector<rgba> temperature_key_colors{
+   inline constexpr std::array<rgba, 5> temperature_keys{{
       {48, 18, 59, 255}, // Dark Purple
       {49, 54, 149, 255}, // Blue
       {253, 231, 37, 255}, // Yellow
       {224, 163, 0, 255}, // Orange
       {136, 0, 0, 255} // Dark Red
-   };
+   }};
+
+   // The key colors as vectors, the type these names had before the constexpr tables, kept for existing callers
+   inline const std::vector<rgba> raindbow_key_colors(rainbow_keys.begin(), rainbow_keys.end());
+   inline const std::vector<rgba> viridis_key_colors(viridis_keys.begin(), viridis_keys.end());
+   inline const std::vector<rgba> jet_key_colors(jet_keys.begin(), jet_keys.end());
+   inline const std::vector<rgba> soft_key_colors(soft_keys.begin(), soft_keys.end());
+   inline const std::vector<rgba> inferno_key_colors(inferno_keys.begin(), inferno_keys.end());
+   inline const std::vector<rgba> turbo_key_colors(turbo_keys.begin(), turbo_keys.end());
+   inline const std::vector<rgba> pastel_key_colors(pastel_keys.begin(), pastel_keys.end());
+   inline const std::vector<rgba> temperature_key_colors(temperature_keys.begin(), temperature_keys.end());
+
+   namespace detail
+   {
+      // Key colors, steps between keys and total colors of a memoized scheme, one of steps and colors is 0
+      struct color_scheme_key_view final
+      {
+         std::span<const rgba> key_colors;
+         int steps{};
+         size_t colors{};
+      };
+
+      struct color_scheme_key final
+      {
+         std::vector<rgba> key_colors;
+         int steps{};
+         size_t colors{};
 
-   inline const std::vector<uint8_t> default_color_scheme_data = make_color_scheme(temperature_key_colors);
+         explicit color_scheme_key(const color_scheme_key_view& view)
+            : key_colors(view.key_colors.begin(), view.key_colors.end()), steps(view.steps), colors(view.colors)
+         {}
+      };
+
+      // Orders owned keys and views alike, so lookups never copy the key colors
+      struct color_scheme_key_less final
+      {
+         using is_transparent = void;
+
+         static color_scheme_key_view view(const color_scheme_key& k) noexcept
+         {
+            return {k.key_colors, k.steps, k.colors};
+         }
+         static color_scheme_key_view view(const color_scheme_key_view& k) noexcept { return k; }
+
+         bool operator()(const auto& lhs, const auto& rhs) const noexcept
+         {
+            const color_scheme_key_view a = view(lhs), b = view(rhs);
+            if (a.steps != b.steps) return a.steps < b.steps;
+            if (a.colors != b.colors) return a.colors < b.colors;
+            return std::lexicographical_compare(a.key_colors.begin(), a.key_colors.end(), b.key_colors.begin(),
+                                                b.key_colors.end());
+         }
+      };
+
+      inline constexpr size_t color_scheme_cache_capacity = 64;
+
+      inline auto& color_scheme_cache()
+      {
+         static memo_cache<color_scheme_key, std::vector<uint8_t>, color_scheme_key_less> cache(
+            color_scheme_cache_capacity);
+         return cache;
+      }
+   }
+
+   // Interpolated schemes of the built in key colors
+   inline constexpr auto rainbow_color_scheme = make_fixed_color_scheme(rainbow_keys);
+   inline constexpr auto viridis_color_scheme = make_fixed_color_scheme(viridis_keys);
+   inline constexpr auto jet_color_scheme = make_fixed_color_scheme(jet_keys);
+   inline constexpr auto soft_color_scheme = make_fixed_color_scheme(soft_keys);
+   inline constexpr auto inferno_color_scheme = make_fixed_color_scheme(inferno_keys);
+   inline constexpr auto turbo_color_scheme = make_fixed_color_scheme(turbo_keys);
+   inline constexpr auto pastel_color_scheme = make_fixed_color_scheme(pastel_keys);
+   inline constexpr auto temperature_color_scheme = make_fixed_color_scheme(temperature_keys);
+
+   inline constexpr const auto& default_color_scheme = temperature_color_scheme;
+
+   // default_color_scheme as the vector this name has always been, prefer default_color_scheme in new code
+   inline const std::vector<uint8_t> default_color_scheme_data(default_color_scheme.begin(),
+                                                               default_color_scheme.end());
+
+   // Interpolated custom schemes, built on first use for each (key colors, steps) and shared afterwards
+   // Thread safe. At most color_scheme_cache_capacity schemes are kept, the least recently used is dropped first,
+   // and a returned scheme stays valid while the caller holds it
+   inline std::shared_ptr<const std::vector<uint8_t>> cached_color_scheme(std::span<const rgba> key_colors,
+                                                                           int steps_between_keys = 128)
+   {
+      return detail::color_scheme_cache().get(detail::color_scheme_key_view{key_colors, steps_between_keys, 0},
+                                              [&] { return make_color_scheme(key_colors, steps_between_keys); });
+   }
+
+   // Memoized make_color_scheme_sized
+   inline std::shared_ptr<const std::vector<uint8_t>> cached_color_scheme_sized(std::span<const rgba> key_colors,
+                                                                                 size_t colors)
+   {
+      return detail::color_scheme_cache().get(detail::color_scheme_key_view{key_colors, 0, colors},
+                                              [&] { return make_color_scheme_sized(key_colors, colors); });
+   }
 }
@@ -0,0 +1,285 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/simd.hpp"
+
+namespace plotz
+{
+   // Element types plots can store and render: arithmetic types, and _Float16 where the compiler provides it
+   template <class T>
+   concept plot_value = std::is_arithmetic_v<T>
+#if defined(__FLT16_MAX__)
+                        || std::same_as<T, _Float16>
+#endif
+      ;
+
+   // A color scheme packed into one uint32_t per color, holding the RGBA bytes in memory order
+   struct palette final
+   {
+      std::vector<uint32_t> colors;
+
+      palette() = default;
+
+      // scheme holds 4 bytes (RGBA) per color, as produced by make_color_scheme
+      explicit palette(std::span<const uint8_t> scheme) : colors(scheme.size() / 4)
+      {
+         std::memcpy(colors.data(), scheme.data(), colors.size() * 4);
+      }
+
+      size_t size() const noexcept { return colors.size(); }
+      bool empty() const noexcept { return colors.empty(); }
+   };
+
+   // Colorizes n values into RGBA pixels
+   // Each value is mapped to t = clamp((v - offset) * scale, 0, 1) and then to the nearest palette entry
+   // An empty palette produces transparent black
+   inline void colorize(const float* src, size_t n, float offset, float scale, const palette& pal,
+                        uint8_t* out) noexcept
+   {
+      PLOTZ_COUNT_PIXELS(n);
+      if (pal.empty()) {
+         std::memset(out, 0, n * 4);
+         return;
+      }
+
+      const uint32_t* lut = pal.colors.data();
+      const float max_index = float(pal.size() - 1);
+      // Fold the palette size into the scale, so there is a single multiply per value
+      const float index_scale = scale * max_index;
+      size_t i = 0;
+
+#if defined(__AVX2__)
+      {
+         const __m256 voffset = _mm256_set1_ps(offset);
+         const __m256 vscale = _mm256_set1_ps(index_scale);
+         const __m256 vmax = _mm256_set1_ps(max_index);
+         const __m256 vhalf = _mm256_set1_ps(0.5f);
+         const __m256 vzero = _mm256_setzero_ps();
+         for (; i + 8 <= n; i += 8) {
+            __m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(src + i), voffset), vscale);
+            t = _mm256_min_ps(_mm256_max_ps(t, vzero), vmax); // NaN maps to 0
+            const __m256i idx = _mm256_cvttps_epi32(_mm256_add_ps(t, vhalf));
+            const __m256i rgba = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), idx, 4);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), rgba);
+         }
+      }
+#elif defined(PLOTZ_SSE2)
+      {
+         const __m128 voffset = _mm_set1_ps(offset);
+         const __m128 vscale = _mm_set1_ps(index_scale);
+         const __m128 vmax = _mm_set1_ps(max_index);
+         const __m128 vhalf = _mm_set1_ps(0.5f);
+         const __m128 vzero = _mm_setzero_ps();
+         alignas(16) int32_t idx[4];
+         for (; i + 4 <= n; i += 4) {
+            __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i), voffset), vscale);
+            t = _mm_min_ps(_mm_max_ps(t, vzero), vmax);
+            _mm_store_si128(reinterpret_cast<__m128i*>(idx), _mm_cvttps_epi32(_mm_add_ps(t, vhalf)));
+            const __m128i rgba =
+               _mm_setr_epi32(int(lut[idx[0]]), int(lut[idx[1]]), int(lut[idx[2]]), int(lut[idx[3]]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), rgba);
+         }
+      }
+#elif defined(__ARM_NEON)
+      {
+         const float32x4_t voffset = vdupq_n_f32(offset);
+         const float32x4_t vscale = vdupq_n_f32(index_scale);
+         const float32x4_t vmax = vdupq_n_f32(max_index);
+         const float32x4_t vhalf = vdupq_n_f32(0.5f);
+         const float32x4_t vzero = vdupq_n_f32(0.0f);
+         uint32_t idx[4];
+         for (; i + 4 <= n; i += 4) {
+            float32x4_t t = vmulq_f32(vsubq_f32(vld1q_f32(src + i), voffset), vscale);
+            t = vminq_f32(vmaxq_f32(t, vzero), vmax);
+            vst1q_u32(idx, vcvtq_u32_f32(vaddq_f32(t, vhalf)));
+            const uint32_t rgba[4] = {lut[idx[0]], lut[idx[1]], lut[idx[2]], lut[idx[3]]};
+            std::memcpy(out + i * 4, rgba, 16);
+         }
+      }
+#endif
+
+      for (; i < n; ++i) {
+         float t = (src[i] - offset) * index_scale;
+         t = (t > 0.0f) ? (std::min)(t, max_index) : 0.0f;
+         const uint32_t rgba = lut[static_cast<size_t>(t + 0.5f)];
+         std::memcpy(out + i * 4, &rgba, 4);
+      }
+   }
+
+   // Colorizes a packed out.width x out.height grid of values into out, row by row when out is strided
+   inline void colorize(const float* src, float offset, float scale, const palette& pal, const image_view& out) noexcept
+   {
+      if (out.packed()) {
+         colorize(src, size_t(out.width) * out.height, offset, scale, pal, out.data);
+         return;
+      }
+
+      for (uint32_t y = 0; y < out.height; ++y) {
+         colorize(src + size_t(y) * out.width, out.width, offset, scale, pal, out.row(y));
+      }
+   }
+
+   // Colorizes n values of a non float type
+   // 32 bit or narrower integers with offset 0 compute palette indices in fixed point without converting to float,
+   // other types are converted in chunks that stay in L1
+   template <plot_value T>
+      requires(!std::same_as<T, float>)
+   inline void colorize(const T* src, size_t n, float offset, float scale, const palette& pal, uint8_t* out) noexcept
+   {
+      if (pal.empty()) {
+         std::memset(out, 0, n * 4);
+         return;
+      }
+
+      if constexpr (std::integral<T> && sizeof(T) <= 4) {
+         const uint32_t max_index = uint32_t(pal.size() - 1);
+         const double index_scale = double(scale) * max_index; // Palette indices per unit of value
+         if (offset == 0.0f && index_scale > 0.0 && index_scale < double(1u << 31)) {
+            // index = floor(v * index_scale + 0.5) with index_scale in 32.32 fixed point. Values at or above
+            // `limit` take the last color, which keeps every product below max_index * 2^32.
+            const uint64_t mul = uint64_t(index_scale * 4294967296.0 + 0.5);
+            const double limit = double(max_index) / index_scale;
+            const uint64_t saturated = limit < 4294967296.0 ? uint64_t(limit) : UINT64_MAX;
+            PLOTZ_COUNT_PIXELS(n);
+            const uint32_t* lut = pal.colors.data();
+            for (size_t i = 0; i < n; ++i) {
+               uint32_t index = 0;
+               if (src[i] > 0) {
+                  const uint64_t v = uint64_t(src[i]);
+                  index = v >= saturated ? max_index
+                                         : (std::min)(max_index, uint32_t((v * mul + (uint64_t(1) << 31)) >> 32));
+               }
+               std::memcpy(out + i * 4, lut + index, 4);
+            }
+            return;
+         }
+      }
+
+      static constexpr size_t chunk = 256;
+      float converted[chunk];
+      for (size_t i = 0; i < n; i += chunk) {
+         const size_t count = (std::min)(chunk, n - i);
+         std::transform(src + i, src + i + count, converted, [](T v) { return static_cast<float>(v); });
+         colorize(converted, count, offset, scale, pal, out + i * 4);
+      }
+   }
+
+   template <plot_value T>
+      requires(!std::same_as<T, float>)
+   inline void colorize(const T* src, float offset, float scale, const palette& pal, const image_view& out) noexcept
+   {
+      if (out.packed()) {
+         colorize(src, size_t(out.width) * out.height, offset, scale, pal, out.data);
+         return;
+      }
+
+      for (uint32_t y = 0; y < out.height; ++y) {
+         colorize(src + size_t(y) * out.width, out.width, offset, scale, pal, out.row(y));
+      }
+   }
+
+   // Largest palette an 8 bit index can address, as used by indexed PNG output
+   inline constexpr size_t max_indexed_colors = 256;
+
+   // Palette of at most max_indexed_colors entries, larger palettes are subsampled evenly keeping both ends
+   inline palette indexed_palette(const palette& pal)
+   {
+      if (pal.size() <= max_indexed_colors) return pal;
+      palette out;
+      out.colors.resize(max_indexed_colors);
+      const double step = double(pal.size() - 1) / double(max_indexed_colors - 1);
+      for (size_t i = 0; i < max_indexed_colors; ++i) out.colors[i] = pal.colors[size_t(i * step + 0.5)];
+      return out;
+   }
+
+   inline palette indexed_palette(std::span<const uint8_t> scheme) { return indexed_palette(palette(scheme)); }
+
+   // Maps n values to 8 bit indices into a palette of palette_size <= 256 colors
+   // Same mapping as colorize, so colorize(src, ...) equals looking the indices up in the palette
+   inline void colorize_indices(const float* src, size_t n, float offset, float scale, size_t palette_size,
+                                uint8_t* out) noexcept
+   {
+      assert(palette_size <= max_indexed_colors);
+      PLOTZ_COUNT_PIXELS(n);
+      if (palette_size == 0) {
+         std::memset(out, 0, n);
+         return;
+      }
+
+      const float max_index = float(palette_size - 1);
+      const float index_scale = scale * max_index;
+      size_t i = 0;
+
+#if defined(PLOTZ_SSE2)
+      {
+         const __m128 voffset = _mm_set1_ps(offset);
+         const __m128 vscale = _mm_set1_ps(index_scale);
+         const __m128 vmax = _mm_set1_ps(max_index);
+         const __m128 vhalf = _mm_set1_ps(0.5f);
+         const __m128 vzero = _mm_setzero_ps();
+         auto indices = [&](size_t at) {
+            __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + at), voffset), vscale);
+            t = _mm_min_ps(_mm_max_ps(t, vzero), vmax); // NaN maps to 0
+            return _mm_cvttps_epi32(_mm_add_ps(t, vhalf));
+         };
+         for (; i + 16 <= n; i += 16) {
+            // Indices are at most 255, so the saturating packs are exact
+            const __m128i lo = _mm_packs_epi32(indices(i), indices(i + 4));
+            const __m128i hi = _mm_packs_epi32(indices(i + 8), indices(i + 12));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+         }
+      }
+#elif defined(__ARM_NEON)
+      {
+         const float32x4_t voffset = vdupq_n_f32(offset);
+         const float32x4_t vscale = vdupq_n_f32(index_scale);
+         const float32x4_t vmax = vdupq_n_f32(max_index);
+         const float32x4_t vhalf = vdupq_n_f32(0.5f);
+         const float32x4_t vzero = vdupq_n_f32(0.0f);
+         auto indices = [&](size_t at) {
+            float32x4_t t = vmulq_f32(vsubq_f32(vld1q_f32(src + at), voffset), vscale);
+            t = vminq_f32(vmaxq_f32(t, vzero), vmax);
+            return vmovn_u32(vcvtq_u32_f32(vaddq_f32(t, vhalf)));
+         };
+         for (; i + 8 <= n; i += 8) {
+            vst1_u8(out + i, vmovn_u16(vcombine_u16(indices(i), indices(i + 4))));
+         }
+      }
+#endif
+
+      for (; i < n; ++i) {
+         float t = (src[i] - offset) * index_scale;
+         t = (t > 0.0f) ? (std::min)(t, max_index) : 0.0f;
+         out[i] = uint8_t(t + 0.5f);
+      }
+   }
+
+   // colorize_indices for values of a non float type, converted in chunks that stay in L1
+   template <plot_value T>
+      requires(!std::same_as<T, float>)
+   inline void colorize_indices(const T* src, size_t n, float offset, float scale, size_t palette_size,
+                                uint8_t* out) noexcept
+   {
+      static constexpr size_t chunk = 256;
+      float converted[chunk];
+      for (size_t i = 0; i < n; i += chunk) {
+         const size_t count = (std::min)(chunk, n - i);
+         std::transform(src + i, src + i + count, converted, [](T v) { return static_cast<float>(v); });
+         colorize_indices(converted, count, offset, scale, palette_size, out + i);
+      }
+   }
+}
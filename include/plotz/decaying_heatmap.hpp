@@ -0,0 +1,130 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#include "plotz/color_scheme.hpp"
+#include "plotz/colorize.hpp"
+#include "plotz/heatmap.hpp"
+#include "plotz/image.hpp"
+
+namespace plotz
+{
+   // Heatmap whose heat decays exponentially over time, for rolling views of streaming data
+   // Decay never touches the pixels: the true heat is the stored heat times a global scale factor, decay shrinks
+   // the factor and new points are stored divided by it. Once the factor gets tiny the buffer is renormalized in
+   // one pass. Auto saturated renders do not change with decay, since every pixel scales alike.
+   struct decaying_heatmap final
+   {
+      // half_life is in the caller's time unit, used by advance()
+      decaying_heatmap(uint32_t width_in, uint32_t height_in, float half_life_in) noexcept
+         : half_life(half_life_in),
+           map(width_in, height_in)
+      {
+         assert(half_life > 0.0f);
+      }
+
+      float half_life{};
+      // Renormalize when the scale factor drops below this, keeping stored values well inside float range
+      float renormalize_below = 1e-12f;
+
+      uint32_t width() const noexcept { return map.width; }
+      uint32_t height() const noexcept { return map.height; }
+
+      // Factor converting stored heat to true heat
+      float scale() const noexcept { return heat_scale; }
+
+      // Underlying accumulator, holding the heat divided by scale()
+      const heatmap& accumulator() const noexcept { return map; }
+
+      float value(uint32_t x, uint32_t y) const noexcept { return map.buffer[size_t(y) * map.width + x] * heat_scale; }
+
+      float current_max_heat() const noexcept { return map.current_max_heat() * heat_scale; }
+
+      // Ages the heat by elapsed time units
+      void advance(float elapsed) { decay(std::exp2(-elapsed / half_life)); }
+
+      // Multiplies all heat by factor in [0, 1]
+      void decay(float factor)
+      {
+         assert(factor >= 0.0f && factor <= 1.0f);
+         if (factor == 0.0f) {
+            clear();
+            return;
+         }
+         heat_scale *= factor;
+         if (heat_scale < renormalize_below) renormalize();
+      }
+
+      // Folds the scale factor into the buffer
+      void renormalize()
+      {
+         for (auto& v : map.buffer) v *= heat_scale;
+         map.max_heat *= heat_scale;
+         heat_scale = 1.0f;
+         map.mark_all_dirty();
+      }
+
+      void clear()
+      {
+         std::fill(map.buffer.begin(), map.buffer.end(), 0.0f);
+         map.max_heat = 0.0f;
+         map.extrema_dirty = false;
+         heat_scale = 1.0f;
+         map.mark_all_dirty();
+      }
+
+      void add_point(uint32_t x, uint32_t y) { map.add_weighted_point(x, y, 1.0f / heat_scale); }
+
+      void add_weighted_point(uint32_t x, uint32_t y, float weight)
+      {
+         map.add_weighted_point(x, y, weight / heat_scale);
+      }
+
+      void add_point_with_stamp(uint32_t x, uint32_t y, const heatmap_stamp& stamp)
+      {
+         map.add_weighted_point_with_stamp(x, y, 1.0f / heat_scale, stamp);
+      }
+
+      template <uint32_t R>
+      void add_point_with_stamp(uint32_t x, uint32_t y, const fixed_stamp<R>& stamp)
+      {
+         map.add_weighted_point_with_stamp(x, y, 1.0f / heat_scale, stamp);
+      }
+
+      void add_points(std::span<const point> points) { map.add_points(points, 1.0f / heat_scale); }
+
+      void add_weighted_points(std::span<const weighted_point> points)
+      {
+         map.add_weighted_points(points, 1.0f / heat_scale);
+      }
+
+      // Auto saturated renders, relative to the current maximum
+      void render_into(const image_view& out) const { map.render_into(out); }
+      void render_into(const image_view& out, const auto& colors) const { map.render_into(out, colors); }
+
+      // Saturation in true heat units, so output fades as the heat decays
+      void render_saturated_into(const image_view& out, const auto& colors, float saturation) const
+      {
+         map.render_saturated_into(out, colors, saturation / heat_scale);
+      }
+
+      size_t render_dirty(const image_view& out) { return map.render_dirty(out); }
+      size_t render_dirty(const image_view& out, const auto& colors) { return map.render_dirty(out, colors); }
+
+      // Decay changes the stored saturation, so the first call after a decay recolorizes everything
+      size_t render_dirty_saturated(const image_view& out, const auto& colors, float saturation)
+      {
+         return map.render_dirty_saturated(out, colors, saturation / heat_scale);
+      }
+
+     private:
+      heatmap map;
+      float heat_scale = 1.0f;
+   };
+}
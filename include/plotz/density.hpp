@@ -0,0 +1,206 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "plotz/heatmap.hpp"
+#include "plotz/parallel.hpp"
+#include "plotz/simd.hpp"
+
+namespace plotz
+{
+   // Radii of `passes` box filters whose repeated application approximates a Gaussian with standard deviation sigma
+   // Box widths are the two odd integers around the ideal width, mixed so the summed variance matches sigma^2
+   inline std::vector<uint32_t> gaussian_box_radii(float sigma, uint32_t passes = 3)
+   {
+      assert(passes > 0);
+      std::vector<uint32_t> radii(passes);
+      if (sigma <= 0.0f) return radii;
+
+      const double n = passes;
+      const double variance = double(sigma) * sigma;
+      int lower = int(std::sqrt(12.0 * variance / n + 1.0));
+      if (lower % 2 == 0) --lower;
+      const int upper = lower + 2;
+      const double ideal_lower_count = (12.0 * variance - n * lower * lower - 4.0 * n * lower - 3.0 * n) /
+                                       (-4.0 * lower - 4.0);
+      const uint32_t lower_count = uint32_t(std::clamp(std::lround(ideal_lower_count), 0l, long(passes)));
+
+      for (uint32_t i = 0; i < passes; ++i) {
+         radii[i] = uint32_t(((i < lower_count ? lower : upper) - 1) / 2);
+      }
+      return radii;
+   }
+
+   // Box filter of width 2 * radius + 1 across one row, values outside the row count as zero
+   // Running sum, so the cost does not depend on the radius
+   inline void box_blur_row(const float* src, float* dst, uint32_t n, uint32_t radius) noexcept
+   {
+      const float inv = 1.0f / float(2 * radius + 1);
+      double sum = 0.0;
+      const uint32_t head = (std::min)(radius, n);
+      for (uint32_t i = 0; i < head; ++i) sum += src[i];
+
+      for (uint32_t x = 0; x < n; ++x) {
+         if (x + radius < n) sum += src[x + radius];
+         dst[x] = float(sum) * inv;
+         if (x >= radius) sum -= src[x - radius];
+      }
+   }
+
+   // Vertical box filter over columns [col_begin, col_end), reading src and writing dst (both width x height)
+   inline void box_blur_columns(const float* src, float* dst, uint32_t width, uint32_t height, uint32_t radius,
+                                uint32_t col_begin, uint32_t col_end)
+   {
+      const float inv = 1.0f / float(2 * radius + 1);
+      const uint32_t n = col_end - col_begin;
+      std::vector<double> sums(n);
+      auto add = [&](uint32_t y, double sign) {
+         const float* row = src + size_t(y) * width + col_begin;
+         for (uint32_t i = 0; i < n; ++i) sums[i] += sign * row[i];
+      };
+
+      const uint32_t head = (std::min)(radius, height);
+      for (uint32_t y = 0; y < head; ++y) add(y, 1.0);
+
+      for (uint32_t y = 0; y < height; ++y) {
+         if (y + radius < height) add(y + radius, 1.0);
+         float* out = dst + size_t(y) * width + col_begin;
+         for (uint32_t i = 0; i < n; ++i) out[i] = float(sums[i]) * inv;
+         if (y >= radius) add(y - radius, -1.0);
+      }
+   }
+
+   // In place approximate Gaussian blur of a width x height grid by repeated separable box filters
+   // O(width * height * passes) regardless of sigma, values outside the grid count as zero
+   inline void gaussian_blur(std::span<float> data, uint32_t width, uint32_t height, float sigma, uint32_t passes = 3,
+                             size_t threads = 1)
+   {
+      assert(data.size() == size_t(width) * height);
+      if (width == 0 || height == 0 || sigma <= 0.0f) return;
+
+      const auto radii = gaussian_box_radii(sigma, passes);
+
+      // Horizontal passes row by row, each row stays in cache for all passes
+      parallel_for(height, threads, [&](size_t row_begin, size_t row_end) {
+         std::vector<float> scratch(width);
+         for (size_t y = row_begin; y < row_end; ++y) {
+            float* row = data.data() + y * width;
+            for (const auto r : radii) {
+               box_blur_row(row, scratch.data(), width, r);
+               std::copy(scratch.begin(), scratch.end(), row);
+            }
+         }
+      });
+
+      // Vertical passes ping-pong between data and a scratch grid, split by column ranges
+      std::vector<float> scratch(data.size());
+      float* src = data.data();
+      float* dst = scratch.data();
+      for (const auto r : radii) {
+         parallel_for(width, threads, [&](size_t col_begin, size_t col_end) {
+            box_blur_columns(src, dst, width, height, r, uint32_t(col_begin), uint32_t(col_end));
+         });
+         std::swap(src, dst);
+      }
+      if (src != data.data()) std::copy(scratch.begin(), scratch.end(), data.begin());
+   }
+
+   // Kernel density mode for large radii
+   // Points are splatted as single weighted impulses and the grid is convolved once with an approximate Gaussian
+   // when resolved, so the cost scales with the image size instead of points * radius^2. The kernel is scaled so
+   // one isolated point peaks at its weight, matching the peak of the round heatmap stamps.
+   struct density_heatmap final
+   {
+      density_heatmap(uint32_t width_in, uint32_t height_in, float sigma_in) noexcept
+         : width(width_in), height(height_in), sigma(sigma_in)
+      {}
+
+      uint32_t width{}, height{}; // Dimensions
+      float sigma{}; // Gaussian standard deviation in pixels
+      uint32_t passes = 3; // Box filter passes, more passes approach a true Gaussian
+      std::vector<float> impulses = std::vector<float>(width * height);
+
+      void add_point(uint32_t x, uint32_t y) { add_weighted_point(x, y, 1.0f); }
+
+      void add_weighted_point(uint32_t x, uint32_t y, float weight)
+      {
+         if (x >= width || y >= height || weight < 0.0f) return;
+         impulses[size_t(y) * width + x] += weight;
+      }
+
+      void add_points(std::span<const point> points)
+      {
+         for (const auto& p : points) add_weighted_point(p.x, p.y, 1.0f);
+      }
+
+      void add_weighted_points(std::span<const weighted_point> points)
+      {
+         for (const auto& p : points) add_weighted_point(p.x, p.y, p.weight);
+      }
+
+      void clear() { std::fill(impulses.begin(), impulses.end(), 0.0f); }
+
+      // Blurs the impulses into out, which must be width x height, and updates its max_heat
+      void resolve_into(heatmap& out, size_t threads = 1) const
+      {
+         assert(out.width == width && out.height == height);
+         const auto radii = gaussian_box_radii(sigma, passes);
+         uint32_t extent = 0; // Kernel support on each side
+         for (const auto r : radii) extent += r;
+
+         // Blur on a grid padded by the kernel support, so points near an edge keep the part of their kernel that
+         // lies inside the heatmap, like a stamp clipped at the border
+         const uint32_t padded_w = width + 2 * extent;
+         const uint32_t padded_h = height + 2 * extent;
+         std::vector<float> grid(size_t(padded_w) * padded_h);
+         for (uint32_t y = 0; y < height; ++y) {
+            const float* src = impulses.data() + size_t(y) * width;
+            std::copy(src, src + width, grid.data() + size_t(y + extent) * padded_w + extent);
+         }
+         gaussian_blur(grid, padded_w, padded_h, sigma, passes, threads);
+
+         const float scale = peak_scale(radii, extent);
+         for (uint32_t y = 0; y < height; ++y) {
+            const float* src = grid.data() + size_t(y + extent) * padded_w + extent;
+            float* dst = out.buffer.data() + size_t(y) * width;
+            for (uint32_t x = 0; x < width; ++x) dst[x] = src[x] * scale;
+         }
+
+         out.max_heat = (std::max)(0.0f, simd::min_max(out.buffer.data(), out.buffer.size()).second);
+         out.extrema_dirty = false;
+         out.mark_all_dirty();
+      }
+
+      heatmap resolve(size_t threads = 1) const
+      {
+         heatmap out(width, height);
+         resolve_into(out, threads);
+         return out;
+      }
+
+     private:
+      // Factor bringing the blurred peak of a unit impulse back to 1
+      static float peak_scale(const std::vector<uint32_t>& radii, uint32_t extent)
+      {
+         if (extent == 0) return 1.0f;
+
+         // The kernel is separable, so its peak is the square of the 1D kernel's center value
+         std::vector<float> kernel(2 * extent + 1), scratch(kernel.size());
+         kernel[extent] = 1.0f;
+         for (const auto r : radii) {
+            box_blur_row(kernel.data(), scratch.data(), uint32_t(kernel.size()), r);
+            kernel.swap(scratch);
+         }
+         const float center = kernel[extent];
+         return 1.0f / (center * center);
+      }
+   };
+}
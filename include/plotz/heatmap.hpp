@@ -6,17 +6,34 @@
 // Originally from: https://github.com/lucasb-eyer/libheatmap
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <concepts>
 #include <cstring>
 #include <functional>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 #include "plotz/color_scheme.hpp"
+#include "plotz/colorize.hpp"
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/memo_cache.hpp"
+#include "plotz/parallel.hpp"
+#include "plotz/simd.hpp"
 
 namespace plotz
 {
-   inline const std::vector<float> default_stamp_data = {
+   inline constexpr std::array<float, 9 * 9> default_stamp_data = {
       // (Data from stamp_default_4_data in the original code)
       0.0f,       0.0f,       0.1055728f, 0.1753789f, 0.2f, 0.1753789f, 0.1055728f, 0.0f,       0.0f,
       0.0f,       0.1514719f, 0.2788897f, 0.3675445f, 0.4f, 0.3675445f, 0.2788897f, 0.1514719f, 0.0f,
@@ -29,12 +46,85 @@ namespace plotz
       0.0f,       0.0f,       0.1055728f, 0.1753789f, 0.2f, 0.1753789f, 0.1055728f, 0.0f,       0.0f,
    };
 
+   namespace detail
+   {
+      // Newton iteration from above, usable in constant expressions
+      constexpr double constexpr_sqrt(double x) noexcept
+      {
+         if (x <= 0.0) return 0.0;
+         double r = x > 1.0 ? x : 1.0;
+         while (true) {
+            const double next = 0.5 * (r + x / r);
+            if (next >= r) return r;
+            r = next;
+         }
+      }
+   }
+
+   // Stamp with a compile time radius, can be built in constant expressions
+   // Rows are padded with zeros to a multiple of 8 floats and 32 byte aligned, so stamps fully inside the heatmap
+   // are added with whole SIMD registers and loops the compiler unrolls for the fixed size
+   template <uint32_t Radius>
+   struct fixed_stamp final
+   {
+      static constexpr uint32_t radius = Radius;
+      static constexpr uint32_t size = 2 * Radius + 1;
+      static constexpr uint32_t stride = (size + 7) / 8 * 8;
+
+      alignas(32) std::array<float, size_t(stride) * size> data{};
+
+      // Default round stamp, identical to heatmap_stamp(Radius)
+      constexpr fixed_stamp() noexcept
+         : fixed_stamp([](float dist) { return dist; })
+      {}
+
+      // Custom distance shape function, evaluated at compile time for constexpr stamps
+      template <class DistShape>
+         requires std::invocable<DistShape, float>
+      constexpr explicit fixed_stamp(DistShape distshape) noexcept
+      {
+         for (uint32_t y = 0; y < size; ++y) {
+            for (uint32_t x = 0; x < size; ++x) {
+               const int dx = int(x) - int(Radius);
+               const int dy = int(y) - int(Radius);
+               const float dist =
+                  float(detail::constexpr_sqrt(double(dx * dx + dy * dy))) / static_cast<float>(Radius + 1);
+               data[y * stride + x] = 1.0f - std::clamp(float(distshape(dist)), 0.0f, 1.0f);
+            }
+         }
+      }
+
+      // Copy of size x size row major values, e.g. default_stamp_data
+      constexpr explicit fixed_stamp(std::span<const float> values) noexcept
+      {
+         assert(values.size() == size_t(size) * size);
+         for (uint32_t y = 0; y < size; ++y) {
+            std::copy_n(values.data() + y * size, size, data.data() + y * stride);
+         }
+      }
+
+      static constexpr uint32_t get_width() { return size; }
+      static constexpr uint32_t get_height() { return size; }
+      static constexpr uint32_t get_stride() { return stride; }
+      constexpr const float* get_data() const { return data.data(); }
+   };
+
+   namespace detail
+   {
+      inline uint64_t next_stamp_id() noexcept
+      {
+         static std::atomic<uint64_t> next{1};
+         return next.fetch_add(1, std::memory_order_relaxed);
+      }
+   }
+
    struct heatmap_stamp final
    {
-      heatmap_stamp(uint32_t width, uint32_t height, const std::vector<float>& data) noexcept
-         : w(width), h(height), buffer(data)
+      heatmap_stamp(uint32_t width, uint32_t height, std::span<const float> data)
+         : w(width), h(height), buffer(data.begin(), data.end())
       {
          assert(data.size() == w * h);
+         make_fixed_copy();
       }
 
       heatmap_stamp(const heatmap_stamp&) = default;
@@ -58,9 +148,11 @@ namespace plotz
                buffer[y * w + x] = 1.0f - clamped_ds;
             }
          }
+         make_fixed_copy();
       }
 
       // Constructor with custom distance shape function
+      // The stamp is symmetric, so distshape is evaluated once per offset in one octant and mirrored
       heatmap_stamp(unsigned radius, std::function<float(float)> distshape)
       {
          uint32_t d = 2 * radius + 1;
@@ -68,130 +160,799 @@ namespace plotz
          h = d;
          buffer.resize(w * h);
 
-         for (uint32_t y = 0; y < h; ++y) {
-            for (uint32_t x = 0; x < w; ++x) {
-               float dist = std::sqrt(static_cast<float>((x - radius) * (x - radius) + (y - radius) * (y - radius))) /
-                            static_cast<float>(radius + 1);
+         for (uint32_t dy = 0; dy <= radius; ++dy) {
+            for (uint32_t dx = dy; dx <= radius; ++dx) {
+               float dist = std::sqrt(static_cast<float>(dx * dx + dy * dy)) / static_cast<float>(radius + 1);
                float ds = distshape(dist);
                float clamped_ds = std::clamp(ds, 0.0f, 1.0f);
-               buffer[y * w + x] = 1.0f - clamped_ds;
+               const float value = 1.0f - clamped_ds;
+               for (const auto& [ox, oy] : {std::pair{dx, dy}, std::pair{dy, dx}}) {
+                  buffer[(radius + oy) * w + radius + ox] = value;
+                  buffer[(radius + oy) * w + radius - ox] = value;
+                  buffer[(radius - oy) * w + radius + ox] = value;
+                  buffer[(radius - oy) * w + radius - ox] = value;
+               }
             }
          }
+         make_fixed_copy();
       }
 
       uint32_t get_width() const { return w; }
       uint32_t get_height() const { return h; }
+      uint32_t get_stride() const { return w; } // Floats between the start of consecutive rows
       const std::vector<float>& get_buffer() const { return buffer; }
+      const float* get_data() const { return buffer.data(); }
+
+      // Identifies the contents for caches of derived stamps, copies share it since stamps are immutable
+      uint64_t id() const noexcept { return stamp_id; }
+
+      // Padded copy for the radii with a fixed_stamp fast path, heatmaps add it instead of the stamp itself
+      using fixed_copy = std::variant<std::monostate, std::shared_ptr<const fixed_stamp<4>>,
+                                      std::shared_ptr<const fixed_stamp<8>>, std::shared_ptr<const fixed_stamp<16>>,
+                                      std::shared_ptr<const fixed_stamp<32>>>;
+      const fixed_copy& get_fixed() const noexcept { return fixed; }
 
      private:
       uint32_t w, h; // Dimensions
       std::vector<float> buffer;
+      uint64_t stamp_id = detail::next_stamp_id();
+      fixed_copy fixed; // Shared by copies
+
+      void make_fixed_copy()
+      {
+         if (w != h) return;
+         const std::span<const float> values{buffer};
+         switch (w) {
+         case fixed_stamp<4>::size:
+            fixed = std::make_shared<const fixed_stamp<4>>(values);
+            break;
+         case fixed_stamp<8>::size:
+            fixed = std::make_shared<const fixed_stamp<8>>(values);
+            break;
+         case fixed_stamp<16>::size:
+            fixed = std::make_shared<const fixed_stamp<16>>(values);
+            break;
+         case fixed_stamp<32>::size:
+            fixed = std::make_shared<const fixed_stamp<32>>(values);
+            break;
+         default:
+            break;
+         }
+      }
    };
 
    inline const heatmap_stamp default_heatmap_stamp{9, 9, default_stamp_data};
 
+   // Round stamp of the given radius, built on first use and shared afterwards
+   inline const heatmap_stamp& cached_stamp(uint32_t radius)
+   {
+      static std::mutex mutex;
+      static std::map<uint32_t, heatmap_stamp> stamps; // Node based, references stay valid
+      std::lock_guard lock(mutex);
+      return stamps.try_emplace(radius, radius).first->second;
+   }
+
+   // Stamp shaped by distshape, built on first use per radius and shared afterwards
+   // The shape must be stateless, e.g. a captureless lambda, since its type is what identifies it
+   template <class DistShape>
+      requires std::is_empty_v<DistShape> && std::invocable<DistShape, float>
+   inline const heatmap_stamp& cached_stamp(uint32_t radius, DistShape distshape)
+   {
+      static std::mutex mutex;
+      static std::map<uint32_t, heatmap_stamp> stamps; // One map per shape type
+      std::lock_guard lock(mutex);
+      auto it = stamps.find(radius);
+      if (it == stamps.end()) {
+         it = stamps.emplace(radius, heatmap_stamp(radius, std::function<float(float)>(distshape))).first;
+      }
+      return it->second;
+   }
+
+   // Built at compile time, so the point ingestion hot paths read it without any dynamic initialization
+   inline constexpr fixed_stamp<4> default_fixed_stamp{default_stamp_data};
+
    inline size_t get_color_count(auto& colors) { return colors.size() / 4; }
 
-   struct heatmap final
+   struct point final
    {
-      heatmap(uint32_t width_in, uint32_t height_in) noexcept : width(width_in), height(height_in) {}
-      heatmap(const heatmap&) noexcept = default;
-      heatmap(heatmap&&) noexcept = default;
-      heatmap& operator=(const heatmap&) noexcept = default;
-      heatmap& operator=(heatmap&&) noexcept = default;
+      uint32_t x{}, y{};
+   };
 
-      uint32_t width{}, height{}; // Dimensions
-      float max_heat{}; // Maximum heat value
-      std::vector<float> buffer = std::vector<float>(width * height);
+   struct weighted_point final
+   {
+      uint32_t x{}, y{};
+      float weight{};
+   };
 
-      void add_point(uint32_t x, uint32_t y) { add_point_with_stamp(x, y, default_heatmap_stamp); }
+   // Accumulator element types: float, double, _Float16 or unsigned integers holding fixed point heat
+   template <class T>
+   concept heat_value = plot_value<T> && !std::signed_integral<T> && !std::same_as<T, bool>;
 
-      void add_point_with_stamp(uint32_t x, uint32_t y, const heatmap_stamp& stamp)
+   // Stored value per unit of heat, integer accumulators keep heat in fixed point
+   // A uint16_t heatmap saturates at a heat of 255, a uint32_t one at about a million
+   template <heat_value T>
+   inline constexpr float heat_unit = std::unsigned_integral<T> ? (sizeof(T) <= 2 ? 256.0f : 4096.0f) : 1.0f;
+
+   namespace detail
+   {
+      // Rounds heat to fixed point, saturating where a full unit does not fit, e.g. 1.0 in a uint8_t
+      template <std::unsigned_integral T>
+      constexpr T quantize_heat(float heat) noexcept
       {
-         if (x >= width || y >= height) return;
+         const float q = heat * heat_unit<T> + 0.5f;
+         return q >= float((std::numeric_limits<T>::max)()) ? (std::numeric_limits<T>::max)() : T(q);
+      }
+   }
 
-         const auto stamp_w = stamp.get_width();
-         const auto stamp_h = stamp.get_height();
-         const auto& stamp_buf = stamp.get_buffer();
+   // Stamp converted to the fixed point heat of an unsigned integer accumulator
+   // Unweighted points are added with it using integer adds only
+   template <std::unsigned_integral T>
+   struct quantized_stamp final
+   {
+      template <class Stamp>
+      explicit quantized_stamp(const Stamp& stamp)
+         : w(stamp.get_width()),
+           h(stamp.get_height()),
+           stride(stamp.get_stride()),
+           values(size_t(stride) * h)
+      {
+         const float* src = stamp.get_data();
+         for (size_t i = 0; i < values.size(); ++i) values[i] = detail::quantize_heat<T>(src[i]);
+      }
 
-         uint32_t x0 = x < stamp_w / 2 ? (stamp_w / 2 - x) : 0;
-         uint32_t y0 = y < stamp_h / 2 ? (stamp_h / 2 - y) : 0;
-         uint32_t x1 = (x + stamp_w / 2) < width ? stamp_w : stamp_w / 2 + (width - x);
-         uint32_t y1 = (y + stamp_h / 2) < height ? stamp_h : stamp_h / 2 + (height - y);
+      uint32_t get_width() const { return w; }
+      uint32_t get_height() const { return h; }
+      uint32_t get_stride() const { return stride; }
+      const T* get_data() const { return values.data(); }
+
+     private:
+      uint32_t w{}, h{}, stride{};
+      std::vector<T> values;
+   };
+
+   // fixed_stamp converted to fixed point heat, constexpr like the stamp itself
+   template <std::unsigned_integral T, uint32_t Radius>
+   struct quantized_fixed_stamp final
+   {
+      static constexpr uint32_t size = fixed_stamp<Radius>::size;
+      static constexpr uint32_t stride = fixed_stamp<Radius>::stride;
 
-         for (uint32_t iy = y0; iy < y1; ++iy) {
-            uint32_t buf_y = (y + iy) - stamp_h / 2;
-            uint32_t buf_line_idx = buf_y * width + (x + x0) - stamp_w / 2;
-            uint32_t stamp_line_idx = iy * stamp_w + x0;
+      std::array<T, size_t(stride) * size> values{};
 
-            for (uint32_t ix = x0; ix < x1; ++ix, ++buf_line_idx, ++stamp_line_idx) {
-               float stamp_value = stamp_buf[stamp_line_idx];
-               buffer[buf_line_idx] += stamp_value;
-               if (buffer[buf_line_idx] > max_heat) max_heat = buffer[buf_line_idx];
+      constexpr explicit quantized_fixed_stamp(const fixed_stamp<Radius>& stamp) noexcept
+      {
+         for (size_t i = 0; i < values.size(); ++i) values[i] = detail::quantize_heat<T>(stamp.data[i]);
+      }
+
+      static constexpr uint32_t get_width() { return size; }
+      static constexpr uint32_t get_height() { return size; }
+      static constexpr uint32_t get_stride() { return stride; }
+      constexpr const T* get_data() const { return values.data(); }
+   };
+
+   template <std::unsigned_integral T>
+   inline constexpr quantized_fixed_stamp<T, default_fixed_stamp.radius> default_quantized_stamp{
+      default_fixed_stamp};
+
+   namespace detail
+   {
+      inline constexpr size_t quantized_stamp_cache_capacity = 16;
+
+      template <std::unsigned_integral T>
+      inline auto& quantized_stamp_cache()
+      {
+         static memo_cache<uint64_t, quantized_stamp<T>> cache(quantized_stamp_cache_capacity);
+         return cache;
+      }
+   }
+
+   // Quantized copy of stamp, built on first use and shared by later batches with the same stamp or its copies
+   // Looked up by heatmap_stamp::id(), so hits cost one map lookup whatever the stamp size
+   // Thread safe, and a returned stamp stays valid while the caller holds it
+   template <std::unsigned_integral T>
+   inline std::shared_ptr<const quantized_stamp<T>> cached_quantized_stamp(const heatmap_stamp& stamp)
+   {
+      return detail::quantized_stamp_cache<T>().get(stamp.id(), [&] { return quantized_stamp<T>(stamp); });
+   }
+
+   namespace detail
+   {
+      // dst[i] += src[i] * scale for accumulators other than float, unsigned integers round and saturate
+      // Returns the maximum of the updated dst values
+      template <heat_value T>
+      float accumulate_row_as(T* dst, const float* src, float scale, size_t n) noexcept
+      {
+         float row_max = std::numeric_limits<float>::lowest();
+         for (size_t i = 0; i < n; ++i) {
+            if constexpr (std::unsigned_integral<T>) {
+               const uint64_t v = uint64_t(dst[i]) + uint64_t(src[i] * scale + 0.5f);
+               dst[i] = T((std::min<uint64_t>)(v, (std::numeric_limits<T>::max)()));
             }
+            else {
+               dst[i] = T(float(dst[i]) + src[i] * scale);
+            }
+            row_max = (std::max)(row_max, float(dst[i]));
+         }
+         return row_max;
+      }
+
+      // Saturating dst[i] += src[i], returns the maximum of the updated dst values
+      template <std::unsigned_integral T>
+      float add_row_saturated(T* dst, const T* src, size_t n) noexcept
+      {
+         using wide = std::conditional_t<(sizeof(T) < 4), uint32_t, uint64_t>;
+         T row_max = 0;
+         for (size_t i = 0; i < n; ++i) {
+            const wide v = wide(dst[i]) + src[i];
+            dst[i] = T((std::min<wide>)(v, (std::numeric_limits<T>::max)()));
+            row_max = (std::max)(row_max, dst[i]);
+         }
+         return float(row_max);
+      }
+   }
+
+   // Heatmap accumulating into T per pixel
+   // Narrow accumulators cut memory and the bandwidth render needs: uint16_t or _Float16 halve both. Integer
+   // heatmaps add unweighted points with integer stamps and render with fixed point palette lookups.
+   template <heat_value T>
+   struct basic_heatmap final
+   {
+      using value_type = T;
+
+      basic_heatmap(uint32_t width_in, uint32_t height_in) noexcept : width(width_in), height(height_in) {}
+      basic_heatmap(const basic_heatmap&) noexcept = default;
+      basic_heatmap(basic_heatmap&&) noexcept = default;
+      basic_heatmap& operator=(const basic_heatmap&) noexcept = default;
+      basic_heatmap& operator=(basic_heatmap&&) noexcept = default;
+
+      uint32_t width{}, height{}; // Dimensions
+      float max_heat{}; // Maximum heat value, in units of heat (stored value / heat_unit<T>)
+      std::vector<T> buffer = std::vector<T>(width * height);
+
+      // When true, writes skip max tracking and max_heat is recomputed from the buffer when needed
+      bool lazy_extrema{};
+      bool extrema_dirty{}; // max_heat is stale, only set when lazy_extrema is enabled
+
+      // Recomputes max_heat with a vectorized scan if deferred writes made it stale
+      void update_extrema() noexcept
+      {
+         if (extrema_dirty) {
+            max_heat = scan_max_heat();
+            extrema_dirty = false;
          }
       }
 
+      // The up to date maximum heat, scans the buffer if max_heat is stale
+      // Call update_extrema() to cache the result for repeated renders
+      float current_max_heat() const noexcept { return extrema_dirty ? scan_max_heat() : max_heat; }
+
+      void add_point(uint32_t x, uint32_t y) { add_point_with_stamp(x, y, default_fixed_stamp); }
+
+      void add_point_with_stamp(uint32_t x, uint32_t y, const heatmap_stamp& stamp) { add_stamp(x, y, 1.0f, stamp); }
+
+      template <uint32_t R>
+      void add_point_with_stamp(uint32_t x, uint32_t y, const fixed_stamp<R>& stamp)
+      {
+         add_stamp(x, y, 1.0f, stamp);
+      }
+
       void add_weighted_point(uint32_t x, uint32_t y, float weight)
       {
-         add_weighted_point_with_stamp(x, y, weight, default_heatmap_stamp);
+         add_weighted_point_with_stamp(x, y, weight, default_fixed_stamp);
       }
 
       void add_weighted_point_with_stamp(uint32_t x, uint32_t y, float weight, const heatmap_stamp& stamp)
       {
-         if (x >= width || y >= height || weight < 0.0f) return;
+         add_stamp(x, y, weight, stamp);
+      }
 
-         const auto stamp_w = stamp.get_width();
-         const auto stamp_h = stamp.get_height();
-         const auto& stamp_buffer = stamp.get_buffer();
+      template <uint32_t R>
+      void add_weighted_point_with_stamp(uint32_t x, uint32_t y, float weight, const fixed_stamp<R>& stamp)
+      {
+         add_stamp(x, y, weight, stamp);
+      }
 
-         uint32_t x0 = x < stamp_w / 2 ? (stamp_w / 2 - x) : 0;
-         uint32_t y0 = y < stamp_h / 2 ? (stamp_h / 2 - y) : 0;
-         uint32_t x1 = (x + stamp_w / 2) < width ? stamp_w : stamp_w / 2 + (width - x);
-         uint32_t y1 = (y + stamp_h / 2) < height ? stamp_h : stamp_h / 2 + (height - y);
+      // Batch ingestion: max_heat is updated once per batch rather than per pixel
+      void add_points(std::span<const point> points) { add_points_with_stamp(points, default_fixed_stamp); }
 
-         for (uint32_t iy = y0; iy < y1; ++iy) {
-            uint32_t buf_y = (y + iy) - stamp_h / 2;
-            uint32_t buf_line_idx = buf_y * width + (x + x0) - stamp_w / 2;
-            uint32_t stamp_line_idx = iy * stamp_w + x0;
+      void add_points_with_stamp(std::span<const point> points, const heatmap_stamp& stamp)
+      {
+         add_stamps(points, stamp);
+      }
 
-            for (uint32_t ix = x0; ix < x1; ++ix, ++buf_line_idx, ++stamp_line_idx) {
-               float stamp_value = stamp_buffer[stamp_line_idx] * weight;
-               buffer[buf_line_idx] += stamp_value;
-               if (buffer[buf_line_idx] > max_heat) max_heat = buffer[buf_line_idx];
-            }
-         }
+      template <uint32_t R>
+      void add_points_with_stamp(std::span<const point> points, const fixed_stamp<R>& stamp)
+      {
+         add_stamps(points, stamp);
+      }
+
+      void add_weighted_points(std::span<const weighted_point> points)
+      {
+         add_weighted_points_with_stamp(points, default_fixed_stamp);
+      }
+
+      // Batches with every weight multiplied by weight_scale >= 0, e.g. a global decay factor
+      void add_points(std::span<const point> points, float weight_scale)
+      {
+         assert(weight_scale >= 0.0f);
+         add_stamps(points, default_fixed_stamp, weight_scale);
+      }
+
+      void add_weighted_points(std::span<const weighted_point> points, float weight_scale)
+      {
+         assert(weight_scale >= 0.0f);
+         add_stamps(points, default_fixed_stamp, weight_scale);
+      }
+
+      void add_weighted_points_with_stamp(std::span<const weighted_point> points, const heatmap_stamp& stamp)
+      {
+         add_stamps(points, stamp);
+      }
+
+      template <uint32_t R>
+      void add_weighted_points_with_stamp(std::span<const weighted_point> points, const fixed_stamp<R>& stamp)
+      {
+         add_stamps(points, stamp);
+      }
+
+      // Multithreaded batch ingestion
+      // The heatmap is split into horizontal bands with one worker per band. Points are binned by every band their
+      // stamp overlaps, and each worker only writes the stamp rows inside its own band, so stamps crossing a band
+      // edge are split between workers without any locking or merge step.
+      // threads == 0 uses default_thread_count()
+      void add_points_parallel(std::span<const point> points, size_t threads = 0)
+      {
+         add_points_parallel_with_stamp(points, default_fixed_stamp, threads);
+      }
+
+      void add_points_parallel_with_stamp(std::span<const point> points, const heatmap_stamp& stamp,
+                                          size_t threads = 0)
+      {
+         accumulate_banded(points, stamp, threads);
+      }
+
+      template <uint32_t R>
+      void add_points_parallel_with_stamp(std::span<const point> points, const fixed_stamp<R>& stamp,
+                                          size_t threads = 0)
+      {
+         accumulate_banded(points, stamp, threads);
+      }
+
+      void add_weighted_points_parallel(std::span<const weighted_point> points, size_t threads = 0)
+      {
+         add_weighted_points_parallel_with_stamp(points, default_fixed_stamp, threads);
+      }
+
+      void add_weighted_points_parallel_with_stamp(std::span<const weighted_point> points,
+                                                   const heatmap_stamp& stamp, size_t threads = 0)
+      {
+         accumulate_banded(points, stamp, threads);
+      }
+
+      template <uint32_t R>
+      void add_weighted_points_parallel_with_stamp(std::span<const weighted_point> points,
+                                                   const fixed_stamp<R>& stamp, size_t threads = 0)
+      {
+         accumulate_banded(points, stamp, threads);
       }
 
       // Methods to render the heatmap
-      std::vector<uint8_t> render() const { return render(default_color_scheme_data); }
+      std::vector<uint8_t> render() const { return render(default_color_scheme); }
 
       std::vector<uint8_t> render(const auto& colors) const
       {
-         float saturation = max_heat > 0.0f ? max_heat : 1.0f;
+         const float max_value = current_max_heat();
+         float saturation = max_value > 0.0f ? max_value : 1.0f;
          return render_saturated(colors, saturation);
       }
 
       std::vector<uint8_t> render_saturated(const auto& colors, float saturation) const
+      {
+         return render_saturated(palette(colors), saturation);
+      }
+
+      std::vector<uint8_t> render_saturated(const palette& colors, float saturation) const
+      {
+         std::vector<uint8_t> colorbuf(size_t(width) * height * 4);
+         PLOTZ_COUNT_ALLOCATED(colorbuf.size());
+         render_saturated_into({colorbuf.data(), width, height}, colors, saturation);
+         return colorbuf;
+      }
+
+      // Render into caller owned pixels, out must be width x height
+      void render_into(const image_view& out) const { render_into(out, default_color_scheme); }
+
+      // threads splits the rows into that many ranges colorized concurrently, 0 uses default_thread_count()
+      void render_into(const image_view& out, const auto& colors, size_t threads = 1) const
+      {
+         const float max_value = current_max_heat();
+         float saturation = max_value > 0.0f ? max_value : 1.0f;
+         render_saturated_into(out, colors, saturation, threads);
+      }
+
+      void render_saturated_into(const image_view& out, const auto& colors, float saturation, size_t threads = 1) const
+      {
+         render_saturated_into(out, palette(colors), saturation, threads);
+      }
+
+      void render_saturated_into(const image_view& out, const palette& colors, float saturation,
+                                 size_t threads = 1) const
+      {
+         assert(saturation > 0.0f);
+         assert(out.width == width && out.height == height);
+         PLOTZ_SCOPE(render, "heatmap::render_saturated_into");
+
+         const float scale = 1.0f / (saturation * heat_unit<T>);
+         parallel_for(height, threads, [&](size_t row_begin, size_t row_end) {
+            colorize(buffer.data() + row_begin * width, 0.0f, scale, colors,
+                     out.subview(0, uint32_t(row_begin), width, uint32_t(row_end - row_begin)));
+         });
+      }
+
+      // 8 bit indices into a palette of palette_size <= 256 colors, one per pixel, for write_png_indexed
+      // A quarter of the RGBA output, pair them with indexed_palette(colors)
+      std::vector<uint8_t> render_indices(size_t palette_size = max_indexed_colors) const
+      {
+         std::vector<uint8_t> indices(size_t(width) * height);
+         PLOTZ_COUNT_ALLOCATED(indices.size());
+         render_indices_into(indices.data(), palette_size);
+         return indices;
+      }
+
+      void render_indices_into(uint8_t* out, size_t palette_size = max_indexed_colors) const
+      {
+         const float max_value = current_max_heat();
+         render_saturated_indices_into(out, palette_size, max_value > 0.0f ? max_value : 1.0f);
+      }
+
+      void render_saturated_indices_into(uint8_t* out, size_t palette_size, float saturation) const
       {
          assert(saturation > 0.0f);
+         PLOTZ_SCOPE(render, "heatmap::render_saturated_indices_into");
+         colorize_indices(buffer.data(), buffer.size(), 0.0f, 1.0f / (saturation * heat_unit<T>), palette_size, out);
+      }
+
+      // Incremental rendering into a persistent image, out must hold the previous render_dirty output with the same
+      // colors. Only pixels written since the last call are recolorized. The first call, and any call where the
+      // saturation changed since the last one, recolorizes everything. Returns the number of pixels recolorized.
+      size_t render_dirty(const image_view& out) { return render_dirty(out, default_color_scheme); }
 
-         size_t total_pixels = width * height;
-         std::vector<uint8_t> colorbuf(total_pixels * 4);
+      size_t render_dirty(const image_view& out, const auto& colors)
+      {
+         const float max_value = current_max_heat();
+         float saturation = max_value > 0.0f ? max_value : 1.0f;
+         return render_dirty_saturated(out, colors, saturation);
+      }
 
-         size_t ncolors = get_color_count(colors);
+      // Fixed saturation mode: with the same saturation every frame a rising maximum never forces a full render
+      size_t render_dirty_saturated(const image_view& out, const auto& colors, float saturation)
+      {
+         return render_dirty_saturated(out, palette(colors), saturation);
+      }
 
-         for (size_t idx = 0; idx < total_pixels; ++idx) {
-            float val = buffer[idx];
-            val = std::clamp(val / saturation, 0.0f, 1.0f);
+      size_t render_dirty_saturated(const image_view& out, const palette& colors, float saturation)
+      {
+         assert(saturation > 0.0f);
+         assert(out.width == width && out.height == height);
+
+         if (saturation != dirty_saturation) mark_all_dirty();
+         dirty_saturation = saturation;
+
+         PLOTZ_SCOPE(render, "heatmap::render_dirty_saturated");
+         const float scale = 1.0f / (saturation * heat_unit<T>);
+         size_t pixels = 0;
+         const bool tracked = take_dirty_rows([&](uint32_t y, uint32_t x_begin, uint32_t x_end) {
+            colorize(buffer.data() + size_t(y) * width + x_begin, x_end - x_begin, 0.0f, scale, colors,
+                     out.row(y) + size_t(x_begin) * 4);
+            pixels += x_end - x_begin;
+         });
+         if (!tracked) {
+            render_saturated_into(out, colors, saturation);
+            return size_t(width) * height;
+         }
+         return pixels;
+      }
 
-            size_t color_idx = static_cast<size_t>((ncolors - 1) * val + 0.5f);
-            color_idx = (std::min)(color_idx, ncolors - 1);
+      // Passes each row span written since the last call to fn(y, x_begin, x_end) and clears it
+      // Returns false when the spans do not cover every change, on the first call or after mark_all_dirty(), and the
+      // caller must then treat every pixel as changed. The spans have a single consumer: render_dirty and
+      // tile_pyramid builds from the same heatmap each clear them for the other.
+      template <class Fn>
+      bool take_dirty_rows(Fn&& fn)
+      {
+         if (!track_dirty || all_dirty) {
+            dirty_begin.assign(height, (std::numeric_limits<uint32_t>::max)());
+            dirty_end.assign(height, 0);
+            track_dirty = true;
+            all_dirty = false;
+            return false;
+         }
 
-            std::copy_n(colors.begin() + color_idx * 4, 4, colorbuf.begin() + idx * 4);
+         for (uint32_t y = 0; y < height; ++y) {
+            if (dirty_begin[y] >= dirty_end[y]) continue;
+            fn(y, dirty_begin[y], dirty_end[y]);
+            dirty_begin[y] = (std::numeric_limits<uint32_t>::max)();
+            dirty_end[y] = 0;
          }
+         return true;
+      }
 
-         return colorbuf;
+      // Call after writing buffer directly, so the next render_dirty or take_dirty_rows covers everything
+      void mark_all_dirty() noexcept { all_dirty = true; }
+
+     private:
+      // Per row column span [dirty_begin, dirty_end) written since the last take_dirty_rows
+      // Tracking starts with the first take_dirty_rows call, rows are only written by one thread at a time
+      bool track_dirty{};
+      bool all_dirty{};
+      float dirty_saturation{};
+      std::vector<uint32_t> dirty_begin, dirty_end;
+
+      void mark_dirty(size_t row, uint32_t x_begin, uint32_t x_end) noexcept
+      {
+         dirty_begin[row] = (std::min)(dirty_begin[row], x_begin);
+         dirty_end[row] = (std::max)(dirty_end[row], x_end);
+      }
+
+      float scan_max_heat() const noexcept
+      {
+         if constexpr (std::same_as<T, float>) {
+            return (std::max)(0.0f, simd::min_max(buffer.data(), buffer.size()).second);
+         }
+         else if constexpr (std::unsigned_integral<T>) {
+            return float(simd::max_unsigned(buffer.data(), buffer.size())) / heat_unit<T>;
+         }
+         else {
+            float m = 0.0f;
+            for (const auto v : buffer) m = (std::max)(m, float(v));
+            return m / heat_unit<T>;
+         }
+      }
+
+      void update_max_heat(float touched_max) noexcept
+      {
+         if (lazy_extrema) {
+            extrema_dirty = true;
+         }
+         else if (touched_max > max_heat) {
+            max_heat = touched_max;
+         }
+      }
+
+      // Calls fn with the padded fixed_stamp copy of a runtime stamp and returns true, when the stamp has one and the
+      // accumulator is float, the only type with a fixed size fast path
+      template <class Fn>
+      static bool with_fixed_copy(const heatmap_stamp& stamp, Fn&& fn)
+      {
+         if constexpr (std::same_as<T, float>) {
+            return std::visit(
+               [&](const auto& fixed) {
+                  if constexpr (std::same_as<std::remove_cvref_t<decltype(fixed)>, std::monostate>) {
+                     return false;
+                  }
+                  else {
+                     fn(*fixed);
+                     return true;
+                  }
+               },
+               stamp.get_fixed());
+         }
+         else {
+            return false;
+         }
+      }
+
+      template <class Stamp>
+      void add_stamp(uint32_t x, uint32_t y, float weight, const Stamp& stamp)
+      {
+         if constexpr (std::same_as<Stamp, heatmap_stamp>) {
+            if (with_fixed_copy(stamp, [&](const auto& fixed) { add_stamp(x, y, weight, fixed); })) return;
+         }
+         if (x >= width || y >= height || weight < 0.0f) return;
+
+         PLOTZ_COUNT_POINTS(1);
+         update_max_heat(accumulate_stamp(x, y, weight, stamp));
+      }
+
+      template <class Stamp>
+      using stamp_value_t = std::remove_cvref_t<decltype(*std::declval<const Stamp&>().get_data())>;
+
+      // Unweighted points on integer heatmaps use a quantized stamp, cached across batches
+      template <class Point, class Stamp>
+      static constexpr bool quantize_batch =
+         std::unsigned_integral<T> && std::same_as<Point, point> && std::same_as<stamp_value_t<Stamp>, float>;
+
+      // Calls fn with stamp converted for T: the default stamp's conversion is built at compile time, other fixed
+      // stamps are converted on the stack, and runtime stamps come from cached_quantized_stamp
+      template <class Stamp, class Fn>
+      static void with_quantized_stamp(const Stamp& stamp, Fn&& fn)
+      {
+         if constexpr (std::same_as<Stamp, heatmap_stamp>) {
+            fn(*cached_quantized_stamp<T>(stamp));
+         }
+         else {
+            if constexpr (Stamp::radius == default_fixed_stamp.radius) {
+               if (&stamp == &default_fixed_stamp) {
+                  fn(default_quantized_stamp<T>);
+                  return;
+               }
+            }
+            fn(quantized_fixed_stamp<T, Stamp::radius>(stamp));
+         }
+      }
+
+      // Every point weight is multiplied by weight_scale, quantized stamps are only used when it is 1
+      template <class Point, class Stamp>
+      void add_stamps(std::span<const Point> points, const Stamp& stamp, float weight_scale = 1.0f)
+      {
+         if constexpr (std::same_as<Stamp, heatmap_stamp>) {
+            if (with_fixed_copy(stamp, [&](const auto& fixed) { add_stamps(points, fixed, weight_scale); })) return;
+         }
+         if constexpr (quantize_batch<Point, Stamp>) {
+            if (weight_scale == 1.0f) {
+               with_quantized_stamp(stamp, [&](const auto& quantized) { add_stamps(points, quantized); });
+               return;
+            }
+         }
+
+         PLOTZ_SCOPE(accumulate, "heatmap::add_stamps");
+         PLOTZ_COUNT_POINTS(points.size());
+         float batch_max = max_heat;
+         for (const auto& p : points) {
+            if (p.x >= width || p.y >= height) continue;
+            float weight = weight_scale;
+            if constexpr (std::same_as<Point, weighted_point>) {
+               if (p.weight < 0.0f) continue;
+               weight *= p.weight;
+            }
+            batch_max = (std::max)(batch_max, accumulate_stamp(p.x, p.y, weight, stamp));
+         }
+         update_max_heat(batch_max);
+      }
+
+      // Adds the stamp scaled by weight centered at (x, y), which must be inside the heatmap
+      // Only heatmap rows in [row_begin, row_end) are written
+      // Returns the maximum heat of the touched pixels
+      // Quantized stamps add their integer values and ignore weight
+      template <class Stamp>
+      float accumulate_stamp(uint32_t x, uint32_t y, float weight, const Stamp& stamp, uint32_t row_begin = 0,
+                             uint32_t row_end = (std::numeric_limits<uint32_t>::max)()) noexcept
+      {
+         const auto stamp_w = stamp.get_width();
+         const auto stamp_h = stamp.get_height();
+         const auto stamp_stride = stamp.get_stride();
+         const auto* stamp_buf = stamp.get_data();
+
+         float touched_max = std::numeric_limits<float>::lowest();
+         auto add_rows = [&](uint32_t y0, uint32_t y1, uint32_t x0, uint32_t n) {
+            for (uint32_t iy = y0; iy < y1; ++iy) {
+               size_t buf_y = (y + iy) - stamp_h / 2;
+               size_t buf_line_idx = buf_y * width + (x + x0) - stamp_w / 2;
+               size_t stamp_line_idx = size_t(iy) * stamp_stride + x0;
+               if (track_dirty) mark_dirty(buf_y, x + x0 - stamp_w / 2, x + x0 - stamp_w / 2 + n);
+
+               if constexpr (!std::same_as<stamp_value_t<Stamp>, float>) {
+                  const float row_max = detail::add_row_saturated(buffer.data() + buf_line_idx,
+                                                                  stamp_buf + stamp_line_idx, n);
+                  touched_max = (std::max)(touched_max, row_max);
+               }
+               else if constexpr (!std::same_as<T, float>) {
+                  const float row_max = detail::accumulate_row_as(buffer.data() + buf_line_idx,
+                                                                  stamp_buf + stamp_line_idx, weight * heat_unit<T>, n);
+                  touched_max = (std::max)(touched_max, row_max);
+               }
+               else if (lazy_extrema) {
+                  simd::add_row(buffer.data() + buf_line_idx, stamp_buf + stamp_line_idx, weight, n);
+               }
+               else {
+                  const float row_max =
+                     simd::accumulate_row(buffer.data() + buf_line_idx, stamp_buf + stamp_line_idx, weight, n);
+                  touched_max = (std::max)(touched_max, row_max);
+               }
+            }
+         };
+
+         if constexpr (std::same_as<T, float> && requires { Stamp::stride; }) {
+            // Padded rows fit entirely inside the heatmap: add whole rows, padding included, with the compile time
+            // row count and length. The zero padding leaves the neighbouring pixels unchanged.
+            if (x >= stamp_w / 2 && y >= stamp_h / 2 && x - stamp_w / 2 + stamp_stride <= width &&
+                y + stamp_h / 2 < height && y >= row_begin + stamp_h / 2 && y + stamp_h / 2 < row_end) {
+               for (uint32_t iy = 0; iy < Stamp::size; ++iy) {
+                  float* dst = buffer.data() + size_t(y + iy - Stamp::radius) * width + (x - Stamp::radius);
+                  const float* src = stamp_buf + size_t(iy) * Stamp::stride;
+                  if (track_dirty) mark_dirty(y + iy - Stamp::radius, x - Stamp::radius, x + Stamp::radius + 1);
+                  if (lazy_extrema) {
+                     simd::add_row(dst, src, weight, Stamp::stride);
+                  }
+                  else {
+                     touched_max = (std::max)(touched_max, simd::accumulate_row_n<Stamp::stride>(dst, src, weight));
+                  }
+               }
+               return touched_max;
+            }
+         }
+
+         uint32_t x0 = x < stamp_w / 2 ? (stamp_w / 2 - x) : 0;
+         uint32_t y0 = y < stamp_h / 2 ? (stamp_h / 2 - y) : 0;
+         uint32_t x1 = (x + stamp_w / 2) < width ? stamp_w : stamp_w / 2 + (width - x);
+         uint32_t y1 = (y + stamp_h / 2) < height ? stamp_h : stamp_h / 2 + (height - y);
+
+         // Clip the stamp rows to the requested heatmap rows, heatmap row = y + iy - stamp_h / 2
+         if (row_begin + stamp_h / 2 > y) y0 = (std::max)(y0, row_begin + stamp_h / 2 - y);
+         if (row_end < height) y1 = (std::min)(y1, (row_end + stamp_h / 2 > y) ? row_end + stamp_h / 2 - y : 0);
+
+         add_rows(y0, y1, x0, x1 - x0);
+         if constexpr (heat_unit<T> != 1.0f) touched_max /= heat_unit<T>;
+         return touched_max;
+      }
+
+      template <class Point, class Stamp>
+      void accumulate_banded(std::span<const Point> points, const Stamp& stamp, size_t threads)
+      {
+         if constexpr (std::same_as<Stamp, heatmap_stamp>) {
+            if (with_fixed_copy(stamp, [&](const auto& fixed) { accumulate_banded(points, fixed, threads); })) return;
+         }
+         if constexpr (quantize_batch<Point, Stamp>) {
+            with_quantized_stamp(stamp,
+                                 [&](const auto& quantized) { accumulate_banded(points, quantized, threads); });
+            return;
+         }
+
+         if (threads == 0) threads = default_thread_count();
+         const size_t bands = (std::min<size_t>)(threads, height);
+         if (bands <= 1 || points.size() < bands) {
+            add_stamps(points, stamp);
+            return;
+         }
+
+         PLOTZ_SCOPE(accumulate, "heatmap::accumulate_banded");
+         PLOTZ_COUNT_POINTS(points.size());
+         const uint32_t band_rows = uint32_t((height + bands - 1) / bands);
+         const uint32_t half_h = stamp.get_height() / 2;
+
+         // bins[chunk * bands + band] holds the points of an input chunk that overlap a band
+         std::vector<std::vector<Point>> bins(bands * bands);
+         parallel_for(bands, bands, [&](size_t chunk_begin, size_t chunk_end) {
+            for (size_t chunk = chunk_begin; chunk < chunk_end; ++chunk) {
+               const size_t first = points.size() * chunk / bands;
+               const size_t last = points.size() * (chunk + 1) / bands;
+               for (size_t i = first; i < last; ++i) {
+                  const auto& p = points[i];
+                  if (p.x >= width || p.y >= height) continue;
+                  if constexpr (std::same_as<Point, weighted_point>) {
+                     if (p.weight < 0.0f) continue;
+                  }
+                  const uint32_t top = p.y > half_h ? p.y - half_h : 0;
+                  const uint32_t bottom = (std::min)(height - 1, p.y + half_h);
+                  for (uint32_t band = top / band_rows; band <= bottom / band_rows; ++band) {
+                     bins[chunk * bands + band].push_back(p);
+                  }
+               }
+            }
+         });
+
+         std::vector<float> band_max(bands, max_heat);
+         parallel_for(bands, bands, [&](size_t band_begin, size_t band_end) {
+            for (size_t band = band_begin; band < band_end; ++band) {
+               const uint32_t row_begin = uint32_t(band) * band_rows;
+               const uint32_t row_end = (std::min)(height, row_begin + band_rows);
+               float m = band_max[band];
+               for (size_t chunk = 0; chunk < bands; ++chunk) {
+                  for (const auto& p : bins[chunk * bands + band]) {
+                     float weight = 1.0f;
+                     if constexpr (std::same_as<Point, weighted_point>) {
+                        weight = p.weight;
+                     }
+                     m = (std::max)(m, accumulate_stamp(p.x, p.y, weight, stamp, row_begin, row_end));
+                  }
+               }
+               band_max[band] = m;
+            }
+         });
+
+         update_max_heat(*std::max_element(band_max.begin(), band_max.end()));
       }
    };
+
+   using heatmap = basic_heatmap<float>;
 }
@@ -0,0 +1,74 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "plotz/instrument.hpp"
+
+namespace plotz
+{
+   // Non-owning view of RGBA pixels, rows are `stride` bytes apart
+   // Plots render into views, and write_png/render_text_to_image read and draw through them, so frames can be
+   // recycled by the caller without any allocation
+   struct image_view final
+   {
+      uint8_t* data{};
+      uint32_t width{}, height{};
+      size_t stride{}; // Bytes between the start of consecutive rows
+
+      image_view() = default;
+
+      // stride == 0 means tightly packed rows (width * 4)
+      image_view(uint8_t* data_in, uint32_t width_in, uint32_t height_in, size_t stride_in = 0) noexcept
+         : data(data_in),
+           width(width_in),
+           height(height_in),
+           stride(stride_in ? stride_in : size_t(width_in) * 4)
+      {}
+
+      image_view(std::span<uint8_t> pixels, uint32_t width_in, uint32_t height_in) noexcept
+         : image_view(pixels.data(), width_in, height_in)
+      {
+         assert(pixels.size() >= size_t(width) * height * 4);
+      }
+
+      uint8_t* row(uint32_t y) const noexcept { return data + y * stride; }
+
+      bool packed() const noexcept { return stride == size_t(width) * 4; }
+
+      // View of the rectangle [x, x + w) x [y, y + h), sharing this view's rows
+      image_view subview(uint32_t x, uint32_t y, uint32_t w, uint32_t h) const noexcept
+      {
+         assert(x + w <= width && y + h <= height);
+         return {data + y * stride + size_t(x) * 4, w, h, stride};
+      }
+   };
+
+   // Owning RGBA image meant to be reused across frames
+   // resize only reallocates when the image grows, so steady state rendering does not allocate
+   struct image final
+   {
+      uint32_t width{}, height{};
+      std::vector<uint8_t> data;
+
+      image() = default;
+      image(uint32_t width_in, uint32_t height_in) { resize(width_in, height_in); }
+
+      void resize(uint32_t width_in, uint32_t height_in)
+      {
+         width = width_in;
+         height = height_in;
+         const size_t bytes = size_t(width) * height * 4;
+         if (bytes > data.capacity()) PLOTZ_COUNT_ALLOCATED(bytes);
+         data.resize(bytes);
+      }
+
+      image_view view() noexcept { return {data.data(), width, height}; }
+   };
+}
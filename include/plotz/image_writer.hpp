@@ -0,0 +1,397 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/sink.hpp"
+#include "plotz/write_png.hpp"
+
+namespace plotz
+{
+   enum struct image_format : uint32_t {
+      png, // Deflate compressed, smallest files
+      qoi, // Quite OK Image format, lossless with a single fast pass and no entropy coding
+      bmp, // Uncompressed 32 bit BGRA, readable by most viewers
+      raw // "PLOTZRAW", little endian uint32_t width and height, then packed RGBA rows
+   };
+
+   // Row by row encoder, derive from it to plug in another output format
+   // Rows arrive top to bottom in one or more bands and finish() follows the last one.
+   struct image_encoder
+   {
+      virtual ~image_encoder() = default;
+      virtual void write_rows(const image_view& band) = 0;
+      virtual void finish() = 0;
+   };
+
+   // Creates an encoder writing a width x height image into sink
+   using encoder_factory = std::function<std::unique_ptr<image_encoder>(write_callback sink, uint32_t width,
+                                                                        uint32_t height)>;
+
+   namespace detail
+   {
+      // Output buffered per band and handed to the sink in chunks
+      struct encoder_output final
+      {
+         static constexpr size_t flush_size = 64 * 1024;
+
+         write_callback sink;
+         std::vector<uint8_t> bytes;
+
+         void flush()
+         {
+            if (!bytes.empty()) sink(bytes.data(), bytes.size());
+            PLOTZ_COUNT_ENCODED(bytes.size());
+            bytes.clear();
+         }
+
+         void put_u32_le(uint32_t v)
+         {
+            const uint8_t b[4] = {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+            bytes.insert(bytes.end(), b, b + 4);
+         }
+
+         void put_u32_be(uint32_t v)
+         {
+            const uint8_t b[4] = {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)};
+            bytes.insert(bytes.end(), b, b + 4);
+         }
+      };
+
+      // Row accounting shared by the built in encoders
+      struct row_counter final
+      {
+         uint32_t width{}, height{};
+         uint32_t rows_written{};
+         bool finished{};
+
+         void add(const image_view& band)
+         {
+            if (finished) {
+               throw std::runtime_error("Image encoder is closed.");
+            }
+            if (band.width != width) {
+               throw std::runtime_error("Image row band width mismatch.");
+            }
+            if (band.height > height - rows_written) {
+               throw std::runtime_error("Too many rows written to image.");
+            }
+            rows_written += band.height;
+         }
+
+         void finish()
+         {
+            if (finished) {
+               throw std::runtime_error("Image encoder is closed.");
+            }
+            if (rows_written != height) {
+               throw std::runtime_error("Not all image rows written.");
+            }
+            finished = true;
+         }
+      };
+   }
+
+   // Streaming QOI encoder, see https://qoiformat.org/qoi-specification.pdf
+   // Runs of equal pixels, a 64 entry hash of recent colors and small per channel deltas in one pass without entropy
+   // coding. Encodes an order of magnitude faster than PNG, files are larger.
+   struct qoi_encoder final : image_encoder
+   {
+      qoi_encoder(write_callback sink, uint32_t width, uint32_t height) : rows{width, height}
+      {
+         out.sink = std::move(sink);
+         static constexpr uint8_t magic[4] = {'q', 'o', 'i', 'f'};
+         out.bytes.insert(out.bytes.end(), magic, magic + 4);
+         out.put_u32_be(width);
+         out.put_u32_be(height);
+         out.bytes.push_back(4); // RGBA
+         out.bytes.push_back(0); // sRGB with linear alpha
+      }
+
+      void write_rows(const image_view& band) override
+      {
+         rows.add(band);
+         PLOTZ_SCOPE(encode, "qoi_encoder::write_rows");
+         for (uint32_t y = 0; y < band.height; ++y) {
+            const uint8_t* row = band.row(y);
+            for (uint32_t x = 0; x < band.width; ++x) encode(row + size_t(x) * 4);
+            if (out.bytes.size() >= detail::encoder_output::flush_size) out.flush();
+         }
+      }
+
+      void finish() override
+      {
+         rows.finish();
+         if (run > 0) out.bytes.push_back(uint8_t(op_run | (run - 1)));
+         static constexpr uint8_t end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+         out.bytes.insert(out.bytes.end(), end_marker, end_marker + 8);
+         out.flush();
+      }
+
+     private:
+      static constexpr uint8_t op_index = 0x00, op_diff = 0x40, op_luma = 0x80, op_run = 0xc0, op_rgb = 0xfe,
+                               op_rgba = 0xff;
+
+      detail::row_counter rows;
+      detail::encoder_output out;
+      std::array<uint32_t, 64> index{}; // Packed RGBA of recently seen colors
+      uint32_t previous = pack(0, 0, 0, 255);
+      uint32_t run{};
+
+      static constexpr uint32_t pack(uint8_t r, uint8_t g, uint8_t b, uint8_t a) noexcept
+      {
+         return uint32_t(r) | uint32_t(g) << 8 | uint32_t(b) << 16 | uint32_t(a) << 24;
+      }
+
+      void encode(const uint8_t* px)
+      {
+         const uint32_t color = pack(px[0], px[1], px[2], px[3]);
+         if (color == previous) {
+            if (++run == 62) {
+               out.bytes.push_back(uint8_t(op_run | (run - 1)));
+               run = 0;
+            }
+            return;
+         }
+         if (run > 0) {
+            out.bytes.push_back(uint8_t(op_run | (run - 1)));
+            run = 0;
+         }
+
+         const uint32_t slot = (px[0] * 3u + px[1] * 5u + px[2] * 7u + px[3] * 11u) % 64;
+         if (index[slot] == color) {
+            out.bytes.push_back(uint8_t(op_index | slot));
+         }
+         else {
+            index[slot] = color;
+            const uint8_t pr = uint8_t(previous), pg = uint8_t(previous >> 8), pb = uint8_t(previous >> 16);
+            if (px[3] == uint8_t(previous >> 24)) {
+               // Channel differences wrap around, as in the specification
+               const int dr = int8_t(uint8_t(px[0] - pr));
+               const int dg = int8_t(uint8_t(px[1] - pg));
+               const int db = int8_t(uint8_t(px[2] - pb));
+               const int dr_dg = dr - dg;
+               const int db_dg = db - dg;
+               if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                  out.bytes.push_back(uint8_t(op_diff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+               }
+               else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                  out.bytes.push_back(uint8_t(op_luma | (dg + 32)));
+                  out.bytes.push_back(uint8_t((dr_dg + 8) << 4 | (db_dg + 8)));
+               }
+               else {
+                  const uint8_t bytes[4] = {op_rgb, px[0], px[1], px[2]};
+                  out.bytes.insert(out.bytes.end(), bytes, bytes + 4);
+               }
+            }
+            else {
+               const uint8_t bytes[5] = {op_rgba, px[0], px[1], px[2], px[3]};
+               out.bytes.insert(out.bytes.end(), bytes, bytes + 5);
+            }
+         }
+         previous = color;
+      }
+   };
+
+   // Uncompressed top down 32 bit BMP with an alpha channel (BITMAPV4HEADER)
+   struct bmp_encoder final : image_encoder
+   {
+      bmp_encoder(write_callback sink, uint32_t width, uint32_t height) : rows{width, height}
+      {
+         out.sink = std::move(sink);
+         static constexpr uint32_t headers_size = 14 + 108;
+         const uint64_t file_size = headers_size + uint64_t(width) * height * 4;
+         if (file_size > 0xffffffffull) {
+            throw std::runtime_error(std::format("Image of {}x{} is too large for BMP.", width, height));
+         }
+
+         out.bytes.push_back('B');
+         out.bytes.push_back('M');
+         out.put_u32_le(uint32_t(file_size));
+         out.put_u32_le(0); // Reserved
+         out.put_u32_le(headers_size); // Pixel data offset
+
+         out.put_u32_le(108); // BITMAPV4HEADER size
+         out.put_u32_le(width);
+         out.put_u32_le(uint32_t(-int32_t(height))); // Negative height stores rows top down
+         out.put_u32_le(1 | 32 << 16); // 1 plane, 32 bits per pixel
+         out.put_u32_le(3); // BI_BITFIELDS
+         out.put_u32_le(uint32_t(uint64_t(width) * height * 4));
+         out.put_u32_le(2835); // 72 DPI
+         out.put_u32_le(2835);
+         out.put_u32_le(0); // Colors used
+         out.put_u32_le(0); // Important colors
+         out.put_u32_le(0x00ff0000); // Red mask, pixels are stored as BGRA
+         out.put_u32_le(0x0000ff00);
+         out.put_u32_le(0x000000ff);
+         out.put_u32_le(0xff000000);
+         out.put_u32_le(0x73524742); // LCS_sRGB
+         out.bytes.resize(out.bytes.size() + 48); // Unused endpoints and gamma
+      }
+
+      void write_rows(const image_view& band) override
+      {
+         rows.add(band);
+         PLOTZ_SCOPE(encode, "bmp_encoder::write_rows");
+         for (uint32_t y = 0; y < band.height; ++y) {
+            const uint8_t* row = band.row(y);
+            const size_t at = out.bytes.size();
+            out.bytes.resize(at + size_t(band.width) * 4);
+            uint8_t* dst = out.bytes.data() + at;
+            for (uint32_t x = 0; x < band.width; ++x) {
+               dst[x * 4 + 0] = row[x * 4 + 2];
+               dst[x * 4 + 1] = row[x * 4 + 1];
+               dst[x * 4 + 2] = row[x * 4 + 0];
+               dst[x * 4 + 3] = row[x * 4 + 3];
+            }
+            if (out.bytes.size() >= detail::encoder_output::flush_size) out.flush();
+         }
+      }
+
+      void finish() override
+      {
+         rows.finish();
+         out.flush();
+      }
+
+     private:
+      detail::row_counter rows;
+      detail::encoder_output out;
+   };
+
+   // Header and packed RGBA rows passed straight to the sink, for dumps and previews read back by our own tools
+   struct raw_encoder final : image_encoder
+   {
+      raw_encoder(write_callback sink, uint32_t width, uint32_t height) : rows{width, height}
+      {
+         out.sink = std::move(sink);
+         static constexpr uint8_t magic[8] = {'P', 'L', 'O', 'T', 'Z', 'R', 'A', 'W'};
+         out.bytes.insert(out.bytes.end(), magic, magic + 8);
+         out.put_u32_le(width);
+         out.put_u32_le(height);
+         out.flush();
+      }
+
+      void write_rows(const image_view& band) override
+      {
+         rows.add(band);
+         PLOTZ_COUNT_ENCODED(size_t(band.width) * band.height * 4);
+         if (band.packed()) {
+            out.sink(band.data, size_t(band.width) * band.height * 4);
+            return;
+         }
+         for (uint32_t y = 0; y < band.height; ++y) out.sink(band.row(y), size_t(band.width) * 4);
+      }
+
+      void finish() override { rows.finish(); }
+
+     private:
+      detail::row_counter rows;
+      detail::encoder_output out;
+   };
+
+   struct png_encoder final : image_encoder
+   {
+      png_encoder(write_callback sink, uint32_t width, uint32_t height, const png_options& options = {})
+         : writer(std::move(sink), width, height, options)
+      {}
+
+      void write_rows(const image_view& band) override { writer.write_rows(band); }
+      void finish() override { writer.finish(); }
+
+     private:
+      png_writer writer;
+   };
+
+   // options only apply to png
+   inline std::unique_ptr<image_encoder> make_image_encoder(image_format format, write_callback sink, uint32_t width,
+                                                            uint32_t height, const png_options& options = {})
+   {
+      switch (format) {
+      case image_format::png:
+         return std::make_unique<png_encoder>(std::move(sink), width, height, options);
+      case image_format::qoi:
+         return std::make_unique<qoi_encoder>(std::move(sink), width, height);
+      case image_format::bmp:
+         return std::make_unique<bmp_encoder>(std::move(sink), width, height);
+      case image_format::raw:
+         return std::make_unique<raw_encoder>(std::move(sink), width, height);
+      }
+      throw std::runtime_error(std::format("Unknown image format {}.", uint32_t(format)));
+   }
+
+   // Format for a file name: .png, .qoi, .bmp, or .raw/.rgba
+   inline image_format image_format_from_extension(const std::string& filename)
+   {
+      const std::string ext = std::filesystem::path(filename).extension().string();
+      if (ext == ".png") return image_format::png;
+      if (ext == ".qoi") return image_format::qoi;
+      if (ext == ".bmp") return image_format::bmp;
+      if (ext == ".raw" || ext == ".rgba") return image_format::raw;
+      throw std::runtime_error(std::format("No image format for the extension of {}", filename));
+   }
+
+   // Encodes into any callback, with a custom encoder
+   inline void write_image(const write_callback& sink, const image_view& image, const encoder_factory& make_encoder)
+   {
+      auto encoder = make_encoder(sink, image.width, image.height);
+      encoder->write_rows(image);
+      encoder->finish();
+   }
+
+   inline void write_image(const write_callback& sink, const image_view& image, image_format format,
+                           const png_options& options = {})
+   {
+      auto encoder = make_image_encoder(format, sink, image.width, image.height, options);
+      encoder->write_rows(image);
+      encoder->finish();
+   }
+
+   inline void write_image(memory_sink& sink, const image_view& image, image_format format,
+                           const png_options& options = {})
+   {
+      write_image(sink.callback(), image, format, options);
+   }
+
+   inline void write_image(const std::string& filename, const image_view& image, const encoder_factory& make_encoder)
+   {
+      std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(filename.c_str(), "wb"), &fclose);
+      if (!fp) {
+         throw std::runtime_error(std::format("Error writing {}: {}", filename, std::strerror(errno)));
+      }
+      write_image(file_callback(fp.get()), image, make_encoder);
+      if (fclose(fp.release()) != 0) {
+         throw std::runtime_error(std::format("Error closing {}: {}", filename, std::strerror(errno)));
+      }
+   }
+
+   inline void write_image(const std::string& filename, const image_view& image, image_format format,
+                           const png_options& options = {})
+   {
+      write_image(filename, image, [&](write_callback sink, uint32_t width, uint32_t height) {
+         return make_image_encoder(format, std::move(sink), width, height, options);
+      });
+   }
+
+   // Format chosen by the file extension
+   inline void write_image(const std::string& filename, const image_view& image)
+   {
+      write_image(filename, image, image_format_from_extension(filename));
+   }
+}
@@ -0,0 +1,168 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+// Optional instrumentation of the hot paths, enabled by defining PLOTZ_INSTRUMENT (CMake option plotz_INSTRUMENT)
+// Without it the PLOTZ_SCOPE and PLOTZ_COUNT_* macros expand to nothing, so their arguments are not even evaluated.
+// With it, process wide relaxed atomic counters record per stage wall time, points ingested, pixels colorized and
+// bytes allocated or encoded. Read them with instrument::snapshot(), or receive every scope as it closes through
+// instrument::set_scope_callback, e.g. to forward spans to Tracy or Perfetto.
+
+namespace plotz::instrument
+{
+#if defined(PLOTZ_INSTRUMENT)
+   inline constexpr bool enabled = true;
+#else
+   inline constexpr bool enabled = false;
+#endif
+
+   enum struct stage : uint32_t {
+      accumulate, // Adding points and grids to plots
+      render, // Colorizing plots into pixels
+      text, // Drawing text and legends
+      encode // Writing images
+   };
+
+   inline constexpr size_t stage_count = 4;
+
+   constexpr const char* stage_name(stage s) noexcept
+   {
+      constexpr std::array<const char*, stage_count> names{"accumulate", "render", "text", "encode"};
+      return names[size_t(s)];
+   }
+
+   struct stage_stats final
+   {
+      uint64_t calls{}; // Instrumented scopes that closed
+      uint64_t nanoseconds{}; // Wall time summed over those scopes, nested scopes count in both
+   };
+
+   struct stats final
+   {
+      std::array<stage_stats, stage_count> stages{};
+      uint64_t points{}; // Points added to heatmaps, sparse heatmaps and magnitude grids
+      uint64_t pixels_colorized{};
+      uint64_t bytes_allocated{}; // Pixel buffers, tiles and render outputs allocated by the library
+      uint64_t bytes_encoded{}; // Encoded image bytes handed to sinks
+
+      const stage_stats& operator[](stage s) const noexcept { return stages[size_t(s)]; }
+   };
+
+   // Called as each instrumented scope closes, begin is steady_clock nanoseconds since its epoch
+   // Runs on the thread that closed the scope and must not throw
+   using scope_callback =
+      std::function<void(stage s, const char* name, uint64_t begin_nanoseconds, uint64_t duration_nanoseconds)>;
+
+   namespace detail
+   {
+      struct counters final
+      {
+         std::array<std::atomic<uint64_t>, stage_count> calls{};
+         std::array<std::atomic<uint64_t>, stage_count> nanoseconds{};
+         std::atomic<uint64_t> points{};
+         std::atomic<uint64_t> pixels_colorized{};
+         std::atomic<uint64_t> bytes_allocated{};
+         std::atomic<uint64_t> bytes_encoded{};
+      };
+
+      inline counters global;
+      inline scope_callback callback;
+
+      inline void add(std::atomic<uint64_t>& counter, uint64_t n) noexcept
+      {
+         counter.fetch_add(n, std::memory_order_relaxed);
+      }
+   }
+
+   inline stats snapshot() noexcept
+   {
+      auto& g = detail::global;
+      stats s;
+      for (size_t i = 0; i < stage_count; ++i) {
+         s.stages[i] = {g.calls[i].load(std::memory_order_relaxed), g.nanoseconds[i].load(std::memory_order_relaxed)};
+      }
+      s.points = g.points.load(std::memory_order_relaxed);
+      s.pixels_colorized = g.pixels_colorized.load(std::memory_order_relaxed);
+      s.bytes_allocated = g.bytes_allocated.load(std::memory_order_relaxed);
+      s.bytes_encoded = g.bytes_encoded.load(std::memory_order_relaxed);
+      return s;
+   }
+
+   inline void reset() noexcept
+   {
+      auto& g = detail::global;
+      for (size_t i = 0; i < stage_count; ++i) {
+         g.calls[i].store(0, std::memory_order_relaxed);
+         g.nanoseconds[i].store(0, std::memory_order_relaxed);
+      }
+      g.points.store(0, std::memory_order_relaxed);
+      g.pixels_colorized.store(0, std::memory_order_relaxed);
+      g.bytes_allocated.store(0, std::memory_order_relaxed);
+      g.bytes_encoded.store(0, std::memory_order_relaxed);
+   }
+
+   // Set while no instrumented code is running, the callback is read without synchronization
+   inline void set_scope_callback(scope_callback callback) { detail::callback = std::move(callback); }
+
+   inline void count_points(uint64_t n) noexcept { detail::add(detail::global.points, n); }
+   inline void count_pixels(uint64_t n) noexcept { detail::add(detail::global.pixels_colorized, n); }
+   inline void count_allocated(uint64_t bytes) noexcept { detail::add(detail::global.bytes_allocated, bytes); }
+   inline void count_encoded(uint64_t bytes) noexcept { detail::add(detail::global.bytes_encoded, bytes); }
+
+   // Times its lifetime into a stage
+   struct scoped_timer final
+   {
+      using clock = std::chrono::steady_clock;
+
+      scoped_timer(stage s_in, const char* name_in) noexcept : s(s_in), name(name_in), begin(clock::now()) {}
+      scoped_timer(const scoped_timer&) = delete;
+      scoped_timer& operator=(const scoped_timer&) = delete;
+
+      ~scoped_timer()
+      {
+         using std::chrono::nanoseconds;
+         const auto duration = uint64_t(std::chrono::duration_cast<nanoseconds>(clock::now() - begin).count());
+         detail::add(detail::global.calls[size_t(s)], 1);
+         detail::add(detail::global.nanoseconds[size_t(s)], duration);
+         if (detail::callback) {
+            const auto begin_ns = std::chrono::duration_cast<nanoseconds>(begin.time_since_epoch());
+            detail::callback(s, name, uint64_t(begin_ns.count()), duration);
+         }
+      }
+
+     private:
+      stage s;
+      const char* name;
+      clock::time_point begin;
+   };
+}
+
+#if defined(PLOTZ_INSTRUMENT)
+#define PLOTZ_INSTRUMENT_CONCAT_IMPL(a, b) a##b
+#define PLOTZ_INSTRUMENT_CONCAT(a, b) PLOTZ_INSTRUMENT_CONCAT_IMPL(a, b)
+// Times the rest of the enclosing block, e.g. PLOTZ_SCOPE(render, "heatmap::render")
+#define PLOTZ_SCOPE(stage_id, name)                                                                                  \
+   const ::plotz::instrument::scoped_timer PLOTZ_INSTRUMENT_CONCAT(plotz_scope_, __LINE__)                           \
+   {                                                                                                                 \
+      ::plotz::instrument::stage::stage_id, name                                                                     \
+   }
+#define PLOTZ_COUNT_POINTS(n) ::plotz::instrument::count_points(uint64_t(n))
+#define PLOTZ_COUNT_PIXELS(n) ::plotz::instrument::count_pixels(uint64_t(n))
+#define PLOTZ_COUNT_ALLOCATED(bytes) ::plotz::instrument::count_allocated(uint64_t(bytes))
+#define PLOTZ_COUNT_ENCODED(bytes) ::plotz::instrument::count_encoded(uint64_t(bytes))
+#else
+#define PLOTZ_SCOPE(stage_id, name) static_cast<void>(0)
+#define PLOTZ_COUNT_POINTS(n) static_cast<void>(0)
+#define PLOTZ_COUNT_PIXELS(n) static_cast<void>(0)
+#define PLOTZ_COUNT_ALLOCATED(bytes) static_cast<void>(0)
+#define PLOTZ_COUNT_ENCODED(bytes) static_cast<void>(0)
+#endif
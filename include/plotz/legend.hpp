@@ -0,0 +1,89 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+
+#include "plotz/color_scheme.hpp"
+#include "plotz/colorize.hpp"
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/render_text.hpp"
+
+namespace plotz
+{
+   struct legend_options final
+   {
+      uint32_t margin_top = 20, margin_bottom = 20; // Space above and below the color bar, holding the labels
+      uint32_t margin_left = 10, margin_right = 10;
+      std::string font_filename; // No labels when empty
+      uint32_t font_size = 14; // Label size in pixels
+      std::string max_label = "Max";
+      std::string min_label = "Min";
+      rgba background = white;
+      rgba text_color = black; // Alpha is ignored
+   };
+
+   // Draws a legend filling region, typically columns reserved beside the plot in the same image
+   // Render the plot into a subview of the output and the legend into the rest, so nothing is copied:
+   //    plot.render_into(out.subview(0, 0, plot_width, height));
+   //    draw_legend(out.subview(plot_width, 0, legend_width, height), colors, options);
+   // Labels are centered above and below the bar and come from the per thread glyph cache
+   inline void draw_legend(const image_view& region, const palette& colors, const legend_options& options = {})
+   {
+      PLOTZ_SCOPE(text, "draw_legend");
+      uint32_t background;
+      std::memcpy(&background, options.background.data(), 4);
+      for (uint32_t y = 0; y < region.height; ++y) {
+         uint8_t* row = region.row(y);
+         for (uint32_t x = 0; x < region.width; ++x) std::memcpy(row + size_t(x) * 4, &background, 4);
+      }
+
+      const uint32_t bar_left = options.margin_left;
+      const uint32_t bar_top = options.margin_top;
+      if (bar_left + options.margin_right >= region.width || bar_top + options.margin_bottom >= region.height) return;
+      const uint32_t bar_width = region.width - bar_left - options.margin_right;
+      const uint32_t bar_height = region.height - bar_top - options.margin_bottom;
+
+      // One palette lookup per row, the maximum at the top
+      if (!colors.empty()) {
+         const size_t max_index = colors.size() - 1;
+         for (uint32_t y = 0; y < bar_height; ++y) {
+            const float value = bar_height > 1 ? float(bar_height - y - 1) / float(bar_height - 1) : 1.0f;
+            const uint32_t color = colors.colors[(std::min)(size_t(value * max_index + 0.5f), max_index)];
+            uint8_t* row = region.row(bar_top + y) + size_t(bar_left) * 4;
+            for (uint32_t x = 0; x < bar_width; ++x) std::memcpy(row + size_t(x) * 4, &color, 4);
+         }
+      }
+
+      if (options.font_filename.empty()) return;
+
+      ft_context.register_font(options.font_filename);
+      FT_Face face = ft_context.get_font(options.font_filename);
+      // The max label sits on a baseline 5 pixels above the bar, the min label hangs 5 pixels below it
+      auto draw_label = [&](const std::string& label, bool below_bar) {
+         const text_layout& layout = ft_context.layout_text(face, options.font_size, label);
+         int ascent = 0;
+         for (const auto& placed : layout.glyphs) ascent = (std::max)(ascent, placed.g->top);
+         const int baseline = below_bar ? int(bar_top + bar_height) + 5 + ascent : int(bar_top) - 5;
+         const int x0 = (int(region.width) - layout.width) / 2;
+         for (const auto& placed : layout.glyphs) {
+            const glyph& g = *placed.g;
+            blend_glyph(region, g, x0 + placed.pen_x + g.left, baseline + placed.pen_y - g.top, options.text_color);
+         }
+      };
+      draw_label(options.max_label, false);
+      draw_label(options.min_label, true);
+   }
+
+   inline void draw_legend(const image_view& region, std::span<const uint8_t> colors,
+                           const legend_options& options = {})
+   {
+      draw_legend(region, palette(colors), options);
+   }
+}
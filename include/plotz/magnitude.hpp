@@ -6,60 +6,128 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <concepts>
 #include <cstring>
+#include <limits>
 #include <memory>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "plotz/color_scheme.hpp"
+#include "plotz/colorize.hpp"
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/parallel.hpp"
+#include "plotz/simd.hpp"
 
 namespace plotz
 {
-   struct magnitude final
+   // Magnitude plot storing T per pixel, e.g. uint16_t or _Float16 to halve memory and render bandwidth
+   // The extrema are tracked as float whatever T is
+   template <plot_value T>
+   struct basic_magnitude final
    {
-      magnitude(uint32_t width_in, uint32_t height_in) noexcept
+      using value_type = T;
+
+      basic_magnitude(uint32_t width_in, uint32_t height_in) noexcept
          : width(width_in),
            height(height_in)
       {}
 
-      magnitude(const magnitude&) noexcept = default;
-      magnitude(magnitude&&) noexcept = default;
-      magnitude& operator=(const magnitude&) noexcept = default;
-      magnitude& operator=(magnitude&&) noexcept = default;
+      basic_magnitude(const basic_magnitude&) noexcept = default;
+      basic_magnitude(basic_magnitude&&) noexcept = default;
+      basic_magnitude& operator=(const basic_magnitude&) noexcept = default;
+      basic_magnitude& operator=(basic_magnitude&&) noexcept = default;
 
       uint32_t width{}, height{}; // Dimensions of the plot
       float max_magnitude = std::numeric_limits<float>::lowest(); // Maximum magnitude value for normalization
       float min_magnitude = (std::numeric_limits<float>::max)(); // Minimum magnitude value in the buffer
-      std::vector<float> buffer = std::vector<float>(width * height); // Buffer to store magnitude values
+      std::vector<T> buffer = std::vector<T>(width * height); // Buffer to store magnitude values
+
+      // When true, add_point skips min/max tracking and the extrema are recomputed from the whole buffer at render
+      // time, including pixels that were never written (which hold 0)
+      bool lazy_extrema{};
+      bool extrema_dirty{}; // min/max_magnitude are stale, only set when lazy_extrema is enabled
+
+      // Minimum and maximum, scanned from the buffer when deferred writes made min/max_magnitude stale
+      // Leaves the stored extrema untouched, so it is safe to call from concurrent readers
+      std::pair<float, float> current_extrema() const noexcept
+      {
+         if (!extrema_dirty) return {min_magnitude, max_magnitude};
+         if constexpr (std::same_as<T, float>) {
+            return simd::min_max(buffer.data(), buffer.size());
+         }
+         else {
+            float min_value = (std::numeric_limits<float>::max)();
+            float max_value = std::numeric_limits<float>::lowest();
+            for (const auto v : buffer) {
+               min_value = (std::min)(min_value, static_cast<float>(v));
+               max_value = (std::max)(max_value, static_cast<float>(v));
+            }
+            return {min_value, max_value};
+         }
+      }
+
+      // Recomputes min/max_magnitude with a vectorized scan if deferred writes made them stale
+      void update_extrema() noexcept
+      {
+         if (extrema_dirty) {
+            std::tie(min_magnitude, max_magnitude) = current_extrema();
+            extrema_dirty = false;
+         }
+      }
+
+      // Offset and scale of render(): values map to clamp((v - offset) * scale, 0, 1), where a negative minimum
+      // maps to the first color and the maximum to the last
+      std::pair<float, float> normalization() const noexcept
+      {
+         const auto [min_value, max_value] = current_extrema();
+         const float offset = min_value < 0.0f ? min_value : 0.0f;
+         const float range = max_value - offset;
+         return {offset, 1.0f / (range > 0.0f ? range : 1.0f)};
+      }
 
       // Add a point to the buffer
-      void add_point(uint32_t x, uint32_t y, float magnitude_value) noexcept
+      void add_point(uint32_t x, uint32_t y, T magnitude_value) noexcept
       {
          if (x >= width || y >= height) return; // Ignore points outside the plot
+         PLOTZ_COUNT_POINTS(1);
 
          size_t idx = static_cast<size_t>(y) * width + x;
          buffer[idx] = magnitude_value;
 
+         if (lazy_extrema) {
+            extrema_dirty = true;
+            return;
+         }
+
+         const float value = static_cast<float>(magnitude_value);
+
          // Update max_magnitude if necessary
-         if (magnitude_value > max_magnitude) {
-            max_magnitude = magnitude_value;
+         if (value > max_magnitude) {
+            max_magnitude = value;
          }
 
          // Update min_magnitude if necessary
-         if (magnitude_value < min_magnitude) {
-            min_magnitude = magnitude_value;
+         if (value < min_magnitude) {
+            min_magnitude = value;
          }
       }
 
-      // Shift buffer values to handle negative magnitudes
-      void shift_buffer_to_non_negative()
+      // Shift buffer values to handle negative magnitudes, split over threads ranges (0 for default_thread_count())
+      void shift_buffer_to_non_negative(size_t threads = 1)
       {
          if (buffer.empty()) return;
+         update_extrema(); // min_magnitude may be stale with lazy_extrema
 
          // Determine if shifting is necessary
          if (min_magnitude < 0.0f) {
             float shift = -min_magnitude;
-            for (auto& val : buffer) {
-               val += shift;
-            }
+            parallel_for(buffer.size(), threads, [&](size_t begin, size_t end) {
+               for (size_t i = begin; i < end; ++i) buffer[i] = static_cast<T>(static_cast<float>(buffer[i]) + shift);
+            });
             // Adjust max_magnitude after shifting
             max_magnitude += shift;
             // Reset min_magnitude since all values are now non-negative
@@ -68,55 +136,116 @@ namespace plotz
       }
 
       // Render the buffer to a color buffer using a default color scheme
-      std::vector<uint8_t> render() { return render(default_color_scheme_data); }
+      // Rendering only reads the buffer, negative values are offset during colorization instead of shifted in place
+      std::vector<uint8_t> render() const { return render(default_color_scheme); }
 
       // Render the buffer to a color buffer using a specified color scheme
-      std::vector<uint8_t> render(const std::vector<uint8_t>& colors)
+      std::vector<uint8_t> render(std::span<const uint8_t> colors) const
       {
-         shift_buffer_to_non_negative();
-         float saturation = max_magnitude > 0.0f ? max_magnitude : 1.0f;
-         return render_saturated(colors, saturation);
+         std::vector<uint8_t> colorbuf(static_cast<size_t>(width) * height * 4); // Assuming RGBA
+         PLOTZ_COUNT_ALLOCATED(colorbuf.size());
+         render_into({colorbuf.data(), width, height}, colors);
+         return colorbuf;
       }
 
       // Method to render with a specific saturation level
-      std::vector<uint8_t> render_saturated(const std::vector<uint8_t>& colors, float saturation) const
+      std::vector<uint8_t> render_saturated(std::span<const uint8_t> colors, float saturation) const
+      {
+         return render_saturated(palette(colors), saturation);
+      }
+
+      std::vector<uint8_t> render_saturated(const palette& colors, float saturation) const
+      {
+         std::vector<uint8_t> colorbuf(static_cast<size_t>(width) * height * 4); // Assuming RGBA
+         PLOTZ_COUNT_ALLOCATED(colorbuf.size());
+         render_saturated_into({colorbuf.data(), width, height}, colors, saturation);
+         return colorbuf;
+      }
+
+      // Render into caller owned pixels, out must be width x height
+      void render_into(const image_view& out) const { render_into(out, default_color_scheme); }
+
+      // threads splits the rows into that many ranges colorized concurrently, 0 uses default_thread_count()
+      void render_into(const image_view& out, std::span<const uint8_t> colors, size_t threads = 1) const
+      {
+         const auto [offset, scale] = normalization();
+         render_normalized_into(out, palette(colors), offset, scale, threads);
+      }
+
+      void render_saturated_into(const image_view& out, std::span<const uint8_t> colors, float saturation,
+                                 size_t threads = 1) const
+      {
+         render_saturated_into(out, palette(colors), saturation, threads);
+      }
+
+      void render_saturated_into(const image_view& out, const palette& colors, float saturation,
+                                 size_t threads = 1) const
       {
          assert(saturation > 0.0f);
+         render_normalized_into(out, colors, 0.0f, 1.0f / saturation, threads);
+      }
 
-         size_t total_pixels = static_cast<size_t>(width) * height;
-         std::vector<uint8_t> colorbuf(total_pixels * 4); // Assuming RGBA
+      // Colors each value by clamp((v - offset) * scale, 0, 1)
+      void render_normalized_into(const image_view& out, const palette& colors, float offset, float scale,
+                                  size_t threads = 1) const
+      {
+         assert(out.width == width && out.height == height);
+         PLOTZ_SCOPE(render, "magnitude::render_normalized_into");
 
-         size_t ncolors = get_color_count(colors);
-         if (ncolors == 0) {
-            // Handle empty color scheme
-            std::fill(colorbuf.begin(), colorbuf.end(), 0);
-            return colorbuf;
-         }
+         parallel_for(height, threads, [&](size_t row_begin, size_t row_end) {
+            colorize(buffer.data() + row_begin * width, offset, scale, colors,
+                     out.subview(0, uint32_t(row_begin), width, uint32_t(row_end - row_begin)));
+         });
+      }
 
-         for (size_t idx = 0; idx < total_pixels; ++idx) {
-            float val = buffer[idx];
-            // Normalize the value based on the maximum magnitude
-            float normalized = std::clamp(val / saturation, 0.0f, 1.0f);
+      // 8 bit indices into a palette of palette_size <= 256 colors, one per pixel, for write_png_indexed
+      // Normalized like render()
+      std::vector<uint8_t> render_indices(size_t palette_size = max_indexed_colors) const
+      {
+         std::vector<uint8_t> indices(size_t(width) * height);
+         PLOTZ_COUNT_ALLOCATED(indices.size());
+         render_indices_into(indices.data(), palette_size);
+         return indices;
+      }
 
-            // Determine the color index
-            size_t color_idx = static_cast<size_t>((ncolors - 1) * normalized + 0.5f);
-            color_idx = (std::min)(color_idx, ncolors - 1);
+      void render_indices_into(uint8_t* out, size_t palette_size = max_indexed_colors) const
+      {
+         const auto [offset, scale] = normalization();
+         render_normalized_indices_into(out, palette_size, offset, scale);
+      }
 
-            // Assign the color to the buffer
-            std::copy_n(colors.begin() + color_idx * 4, 4, colorbuf.begin() + idx * 4);
-         }
+      void render_saturated_indices_into(uint8_t* out, size_t palette_size, float saturation) const
+      {
+         assert(saturation > 0.0f);
+         render_normalized_indices_into(out, palette_size, 0.0f, 1.0f / saturation);
+      }
 
-         return colorbuf;
+      void render_normalized_indices_into(uint8_t* out, size_t palette_size, float offset, float scale) const
+      {
+         PLOTZ_SCOPE(render, "magnitude::render_normalized_indices_into");
+         colorize_indices(buffer.data(), buffer.size(), offset, scale, palette_size, out);
       }
 
       void reset() noexcept
       {
-         std::fill(buffer.begin(), buffer.end(), 0.0f);
+         std::fill(buffer.begin(), buffer.end(), T{});
          max_magnitude = std::numeric_limits<float>::lowest();
          min_magnitude = (std::numeric_limits<float>::max)();
+         extrema_dirty = false;
       }
    };
 
+   using magnitude = basic_magnitude<float>;
+
+   // How set_grid resamples an input grid to the image size
+   enum struct resample : uint32_t {
+      nearest, // The input sample under each pixel center
+      sum, // Sum of the inputs mapping to each pixel, nearest where none do (upscaling)
+      mean, // Mean of the inputs mapping to each pixel, nearest where none do
+      max, // Maximum of the inputs mapping to each pixel, nearest where none do
+      bilinear // Interpolation between the four inputs around each pixel center, for upscaling
+   };
+
    struct magnitude_mapped final
    {
       // Input dimensions
@@ -131,12 +260,46 @@ namespace plotz
       // Buffer to store magnitude values mapped to image dimensions
       std::vector<float> buffer = std::vector<float>(image_width * image_height, 0.0f);
 
+      // When true, add_point skips min/max tracking and the extrema are recomputed from the whole buffer at render
+      // time, including pixels that were never written (which hold 0)
+      bool lazy_extrema{};
+      bool extrema_dirty{}; // min/max_magnitude are stale, only set when lazy_extrema is enabled
+
+      // Minimum and maximum, scanned from the buffer when deferred writes made min/max_magnitude stale
+      // Leaves the stored extrema untouched, so it is safe to call from concurrent readers
+      std::pair<float, float> current_extrema() const noexcept
+      {
+         if (!extrema_dirty) return {min_magnitude, max_magnitude};
+         return simd::min_max(buffer.data(), buffer.size());
+      }
+
+      // Recomputes min/max_magnitude with a vectorized scan if deferred writes made them stale
+      void update_extrema() noexcept
+      {
+         if (extrema_dirty) {
+            std::tie(min_magnitude, max_magnitude) = current_extrema();
+            extrema_dirty = false;
+         }
+      }
+
+      // Offset and scale of render(): values map to clamp((v - offset) * scale, 0, 1), where a negative minimum
+      // maps to the first color and the maximum to the last
+      std::pair<float, float> normalization() const noexcept
+      {
+         const auto [min_value, max_value] = current_extrema();
+         const float offset = min_value < 0.0f ? min_value : 0.0f;
+         const float range = max_value - offset;
+         return {offset, 1.0f / (range > 0.0f ? range : 1.0f)};
+      }
+
       magnitude_mapped(uint32_t width_in, uint32_t height_in, uint32_t img_width, uint32_t img_height)
          : input_width(width_in),
            input_height(height_in),
            image_width(img_width),
            image_height(img_height)
-      {}
+      {
+         update_scales();
+      }
 
       magnitude_mapped(const magnitude_mapped&) noexcept = default;
       magnitude_mapped(magnitude_mapped&&) noexcept = default;
@@ -148,13 +311,10 @@ namespace plotz
       {
          if (input_width == 0 || input_height == 0) return false;
 
-         // Calculate scaling factors
-         float scale_x = static_cast<float>(image_width) / input_width;
-         float scale_y = static_cast<float>(image_height) / input_height;
-
          // Map input coordinates to image coordinates
-         image_x = static_cast<uint32_t>(input_x * scale_x);
-         image_y = static_cast<uint32_t>(input_y * scale_y);
+         const axis_scales s = current_scales();
+         image_x = static_cast<uint32_t>(input_x * s.x);
+         image_y = static_cast<uint32_t>(input_y * s.y);
 
          // Clamp to image boundaries
          if (image_x >= image_width) image_x = image_width - 1;
@@ -167,22 +327,32 @@ namespace plotz
       void add_point(uint32_t input_x, uint32_t input_y, float magnitude_value) noexcept
       {
          if (input_width == 0 || input_height == 0) return;
-
-         // Calculate scaling factors
-         float scale_x = static_cast<float>(image_width) / input_width;
-         float scale_y = static_cast<float>(image_height) / input_height;
+         PLOTZ_COUNT_POINTS(1);
 
          // Determine the range of pixels to update
-         uint32_t start_x = static_cast<uint32_t>(input_x * scale_x);
-         uint32_t start_y = static_cast<uint32_t>(input_y * scale_y);
+         update_scales();
+         const float sx = scales.x, sy = scales.y;
+         uint32_t start_x = static_cast<uint32_t>(input_x * sx);
+         uint32_t start_y = static_cast<uint32_t>(input_y * sy);
 
          // Calculate the end coordinates, ensuring they don't exceed image dimensions
-         uint32_t end_x = static_cast<uint32_t>((input_x + 1) * scale_x);
-         uint32_t end_y = static_cast<uint32_t>((input_y + 1) * scale_y);
+         uint32_t end_x = static_cast<uint32_t>((input_x + 1) * sx);
+         uint32_t end_y = static_cast<uint32_t>((input_y + 1) * sy);
 
          end_x = (std::min)(end_x, image_width);
          end_y = (std::min)(end_y, image_height);
 
+         if (lazy_extrema) {
+            for (uint32_t img_y = start_y; img_y < end_y; ++img_y) {
+               float* row = buffer.data() + static_cast<size_t>(img_y) * image_width;
+               for (uint32_t img_x = start_x; img_x < end_x; ++img_x) {
+                  row[img_x] += magnitude_value;
+               }
+            }
+            extrema_dirty = true;
+            return;
+         }
+
          // Iterate over the block of pixels and accumulate magnitude
          for (uint32_t img_y = start_y; img_y < end_y; ++img_y) {
             for (uint32_t img_x = start_x; img_x < end_x; ++img_x) {
@@ -202,17 +372,94 @@ namespace plotz
          }
       }
 
-      // Shift buffer values to handle negative magnitudes
-      void shift_buffer_to_non_negative()
+      // Replaces the buffer with a whole input_width x input_height grid (row major) resampled to the image size
+      // Row and column index tables are built once per size and reused, and the grid is read in one pass
+      // Output rows are independent, threads splits them into that many ranges (0 for default_thread_count())
+      void set_grid(std::span<const float> values, resample mode = resample::mean, size_t threads = 1)
+      {
+         assert(values.size() == size_t(input_width) * input_height);
+         if (input_width == 0 || input_height == 0 || image_width == 0 || image_height == 0) return;
+         PLOTZ_SCOPE(accumulate, "magnitude_mapped::set_grid");
+         PLOTZ_COUNT_POINTS(values.size());
+
+         build_grid_tables();
+         const float* in = values.data();
+         const auto& cols = tables.cols;
+
+         parallel_for(image_height, threads, [&](size_t row_begin, size_t row_end) {
+            if (mode == resample::nearest) {
+               for (size_t oy = row_begin; oy < row_end; ++oy) {
+                  const float* src = in + size_t(tables.rows.nearest[oy]) * input_width;
+                  float* dst = buffer.data() + oy * image_width;
+                  for (uint32_t ox = 0; ox < image_width; ++ox) dst[ox] = src[cols.nearest[ox]];
+               }
+            }
+            else if (mode == resample::bilinear) {
+               for (size_t oy = row_begin; oy < row_end; ++oy) {
+                  const float* row0 = in + size_t(tables.rows.lower[oy]) * input_width;
+                  const float* row1 = in + size_t(tables.rows.upper[oy]) * input_width;
+                  const float fy = tables.rows.fraction[oy];
+                  float* dst = buffer.data() + oy * image_width;
+                  for (uint32_t ox = 0; ox < image_width; ++ox) {
+                     const uint32_t x0 = cols.lower[ox], x1 = cols.upper[ox];
+                     const float fx = cols.fraction[ox];
+                     const float top = row0[x0] + (row0[x1] - row0[x0]) * fx;
+                     const float bottom = row1[x0] + (row1[x1] - row1[x0]) * fx;
+                     dst[ox] = top + (bottom - top) * fy;
+                  }
+               }
+            }
+            else {
+               for (size_t oy = row_begin; oy < row_end; ++oy) {
+                  float* dst = buffer.data() + oy * image_width;
+                  const uint32_t y_begin = tables.rows.begin[oy];
+                  const uint32_t y_end = tables.rows.end[oy];
+                  std::fill_n(dst, image_width,
+                              mode == resample::max ? std::numeric_limits<float>::lowest() : 0.0f);
+                  for (uint32_t y = y_begin; y < y_end; ++y) {
+                     const float* src = in + size_t(y) * input_width;
+                     for (uint32_t ox = 0; ox < image_width; ++ox) {
+                        const uint32_t x_end = cols.end[ox];
+                        float v = dst[ox];
+                        if (mode == resample::max) {
+                           for (uint32_t x = cols.begin[ox]; x < x_end; ++x) v = (std::max)(v, src[x]);
+                        }
+                        else {
+                           for (uint32_t x = cols.begin[ox]; x < x_end; ++x) v += src[x];
+                        }
+                        dst[ox] = v;
+                     }
+                  }
+                  if (mode == resample::mean) {
+                     const float rows = float(y_end - y_begin);
+                     for (uint32_t ox = 0; ox < image_width; ++ox) {
+                        dst[ox] /= rows * float(cols.end[ox] - cols.begin[ox]);
+                     }
+                  }
+               }
+            }
+         });
+
+         if (lazy_extrema) {
+            extrema_dirty = true;
+         }
+         else {
+            std::tie(min_magnitude, max_magnitude) = simd::min_max(buffer.data(), buffer.size());
+         }
+      }
+
+      // Shift buffer values to handle negative magnitudes, split over threads ranges (0 for default_thread_count())
+      void shift_buffer_to_non_negative(size_t threads = 1)
       {
          if (buffer.empty()) return;
+         update_extrema(); // min_magnitude may be stale with lazy_extrema
 
          // Determine if shifting is necessary
          if (min_magnitude < 0.0f) {
             float shift = -min_magnitude;
-            for (auto& val : buffer) {
-               val += shift;
-            }
+            parallel_for(buffer.size(), threads, [&](size_t begin, size_t end) {
+               for (size_t i = begin; i < end; ++i) buffer[i] += shift;
+            });
             // Adjust max_magnitude after shifting
             max_magnitude += shift;
             // Reset min_magnitude since all values are now non-negative
@@ -221,45 +468,66 @@ namespace plotz
       }
 
       // Render the buffer to a color buffer using a default color scheme
-      std::vector<uint8_t> render() { return render(default_color_scheme_data); }
+      // Rendering only reads the buffer, negative values are offset during colorization instead of shifted in place
+      std::vector<uint8_t> render() const { return render(default_color_scheme); }
 
       // Render the buffer to a color buffer using a specified color scheme
-      std::vector<uint8_t> render(const std::vector<uint8_t>& colors)
+      std::vector<uint8_t> render(std::span<const uint8_t> colors) const
       {
-         shift_buffer_to_non_negative();
-         float saturation = max_magnitude > 0.0f ? max_magnitude : 1.0f;
-         return render_saturated(colors, saturation);
+         std::vector<uint8_t> colorbuf(static_cast<size_t>(image_width) * image_height * 4); // Assuming RGBA
+         PLOTZ_COUNT_ALLOCATED(colorbuf.size());
+         render_into({colorbuf.data(), image_width, image_height}, colors);
+         return colorbuf;
       }
 
       // Method to render with a specific saturation level
-      std::vector<uint8_t> render_saturated(const std::vector<uint8_t>& colors, float saturation) const
+      std::vector<uint8_t> render_saturated(std::span<const uint8_t> colors, float saturation) const
       {
-         assert(saturation > 0.0f);
+         return render_saturated(palette(colors), saturation);
+      }
 
-         size_t total_pixels = static_cast<size_t>(image_width) * image_height;
-         std::vector<uint8_t> colorbuf(total_pixels * 4, 0); // Assuming RGBA
+      std::vector<uint8_t> render_saturated(const palette& colors, float saturation) const
+      {
+         std::vector<uint8_t> colorbuf(static_cast<size_t>(image_width) * image_height * 4); // Assuming RGBA
+         PLOTZ_COUNT_ALLOCATED(colorbuf.size());
+         render_saturated_into({colorbuf.data(), image_width, image_height}, colors, saturation);
+         return colorbuf;
+      }
 
-         size_t ncolors = get_color_count(colors);
-         if (ncolors == 0) {
-            // Handle empty color scheme
-            std::fill(colorbuf.begin(), colorbuf.end(), 0);
-            return colorbuf;
-         }
+      // Render into caller owned pixels, out must be image_width x image_height
+      void render_into(const image_view& out) const { render_into(out, default_color_scheme); }
+
+      // threads splits the rows into that many ranges colorized concurrently, 0 uses default_thread_count()
+      void render_into(const image_view& out, std::span<const uint8_t> colors, size_t threads = 1) const
+      {
+         const auto [offset, scale] = normalization();
+         render_normalized_into(out, palette(colors), offset, scale, threads);
+      }
 
-         for (size_t idx = 0; idx < total_pixels; ++idx) {
-            float val = buffer[idx];
-            // Normalize the value based on the maximum magnitude
-            float normalized = std::clamp(val / saturation, 0.0f, 1.0f);
+      void render_saturated_into(const image_view& out, std::span<const uint8_t> colors, float saturation,
+                                 size_t threads = 1) const
+      {
+         render_saturated_into(out, palette(colors), saturation, threads);
+      }
 
-            // Determine the color index
-            size_t color_idx = static_cast<size_t>((ncolors - 1) * normalized + 0.5f);
-            color_idx = (std::min)(color_idx, ncolors - 1);
+      void render_saturated_into(const image_view& out, const palette& colors, float saturation,
+                                 size_t threads = 1) const
+      {
+         assert(saturation > 0.0f);
+         render_normalized_into(out, colors, 0.0f, 1.0f / saturation, threads);
+      }
 
-            // Assign the color to the buffer
-            std::copy_n(colors.begin() + color_idx * 4, 4, colorbuf.begin() + idx * 4);
-         }
+      // Colors each value by clamp((v - offset) * scale, 0, 1)
+      void render_normalized_into(const image_view& out, const palette& colors, float offset, float scale,
+                                  size_t threads = 1) const
+      {
+         assert(out.width == image_width && out.height == image_height);
+         PLOTZ_SCOPE(render, "magnitude_mapped::render_normalized_into");
 
-         return colorbuf;
+         parallel_for(image_height, threads, [&](size_t row_begin, size_t row_end) {
+            colorize(buffer.data() + row_begin * image_width, offset, scale, colors,
+                     out.subview(0, uint32_t(row_begin), image_width, uint32_t(row_end - row_begin)));
+         });
       }
 
       void reset() noexcept
@@ -267,6 +535,90 @@ namespace plotz
          std::fill(buffer.begin(), buffer.end(), 0.0f);
          max_magnitude = std::numeric_limits<float>::lowest();
          min_magnitude = (std::numeric_limits<float>::max)();
+         extrema_dirty = false;
+      }
+
+     private:
+      // Image pixels per input sample, cached with the dimensions they were computed for since those are public
+      // and may change
+      struct axis_scales final
+      {
+         uint32_t input_width{}, input_height{}, image_width{}, image_height{};
+         float x{}, y{};
+      } scales;
+
+      axis_scales current_scales() const noexcept
+      {
+         if (scales.input_width == input_width && scales.input_height == input_height &&
+             scales.image_width == image_width && scales.image_height == image_height) {
+            return scales;
+         }
+         return {input_width, input_height, image_width, image_height,
+                 input_width ? static_cast<float>(image_width) / input_width : 0.0f,
+                 input_height ? static_cast<float>(image_height) / input_height : 0.0f};
+      }
+
+      void update_scales() noexcept { scales = current_scales(); }
+
+      // Per output column (or row) resampling indices along one axis
+      struct axis_table final
+      {
+         std::vector<uint32_t> begin, end; // Input range mapping to the pixel, the nearest input if none does
+         std::vector<uint32_t> nearest; // Input under the pixel center
+         std::vector<uint32_t> lower, upper; // Bilinear neighbours
+         std::vector<float> fraction; // Bilinear weight of upper
+
+         void build(uint32_t inputs, uint32_t outputs, float scale)
+         {
+            begin.assign(outputs, 0);
+            end.assign(outputs, 0);
+            nearest.resize(outputs);
+            lower.resize(outputs);
+            upper.resize(outputs);
+            fraction.resize(outputs);
+
+            // Input i maps to pixel floor(i * scale), like map_coordinates, so every input lands in exactly one pixel
+            for (uint32_t i = inputs; i-- > 0;) {
+               const uint32_t o = (std::min)(static_cast<uint32_t>(i * scale), outputs - 1);
+               if (begin[o] == end[o]) end[o] = i + 1;
+               begin[o] = i;
+            }
+
+            for (uint32_t o = 0; o < outputs; ++o) {
+               const float center = (float(o) + 0.5f) / scale;
+               nearest[o] = (std::min)(static_cast<uint32_t>(center), inputs - 1);
+               if (begin[o] == end[o]) {
+                  begin[o] = nearest[o];
+                  end[o] = nearest[o] + 1;
+               }
+
+               const float source = std::clamp(center - 0.5f, 0.0f, float(inputs - 1));
+               lower[o] = static_cast<uint32_t>(source);
+               upper[o] = (std::min)(lower[o] + 1, inputs - 1);
+               fraction[o] = source - float(lower[o]);
+            }
+         }
+      };
+
+      struct grid_tables final
+      {
+         uint32_t input_width{}, input_height{}, image_width{}, image_height{};
+         axis_table cols, rows;
+      } tables;
+
+      void build_grid_tables()
+      {
+         if (tables.input_width == input_width && tables.input_height == input_height &&
+             tables.image_width == image_width && tables.image_height == image_height) {
+            return;
+         }
+         update_scales();
+         tables.cols.build(input_width, image_width, scales.x);
+         tables.rows.build(input_height, image_height, scales.y);
+         tables.input_width = input_width;
+         tables.input_height = input_height;
+         tables.image_width = image_width;
+         tables.image_height = image_height;
       }
    };
 }
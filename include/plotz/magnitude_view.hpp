@@ -0,0 +1,133 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "plotz/color_scheme.hpp"
+#include "plotz/colorize.hpp"
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/simd.hpp"
+
+namespace plotz
+{
+   // Magnitude plot over caller owned values, nothing is copied
+   // Rows are `stride` elements apart, so a view can cover a window of a larger field. Values are normalized like
+   // magnitude::render: negative data is offset so its minimum maps to the first color
+   template <plot_value T>
+   struct magnitude_view final
+   {
+      const T* data{};
+      uint32_t width{}, height{};
+      size_t stride{}; // Elements between the start of consecutive rows
+
+      magnitude_view() = default;
+
+      // stride == 0 means tightly packed rows
+      magnitude_view(const T* data_in, uint32_t width_in, uint32_t height_in, size_t stride_in = 0) noexcept
+         : data(data_in),
+           width(width_in),
+           height(height_in),
+           stride(stride_in ? stride_in : width_in)
+      {}
+
+      magnitude_view(std::span<const T> values, uint32_t width_in, uint32_t height_in) noexcept
+         : magnitude_view(values.data(), width_in, height_in)
+      {
+         assert(values.size() >= size_t(width) * height);
+      }
+
+      const T* row(uint32_t y) const noexcept { return data + y * stride; }
+
+      // View of the rectangle [x, x + w) x [y, y + h)
+      magnitude_view subview(uint32_t x, uint32_t y, uint32_t w, uint32_t h) const noexcept
+      {
+         assert(x + w <= width && y + h <= height);
+         return {data + y * stride + x, w, h, stride};
+      }
+
+      // {min, max} of the values as float, {max(), lowest()} for an empty view
+      std::pair<float, float> extrema() const noexcept
+      {
+         float lo = (std::numeric_limits<float>::max)();
+         float hi = std::numeric_limits<float>::lowest();
+         if constexpr (std::same_as<T, float>) {
+            if (stride == width) return simd::min_max(data, size_t(width) * height);
+            for (uint32_t y = 0; y < height; ++y) {
+               const auto [row_lo, row_hi] = simd::min_max(row(y), width);
+               lo = (std::min)(lo, row_lo);
+               hi = (std::max)(hi, row_hi);
+            }
+         }
+         else {
+            for (uint32_t y = 0; y < height; ++y) {
+               const T* values = row(y);
+               for (uint32_t x = 0; x < width; ++x) {
+                  const float v = static_cast<float>(values[x]);
+                  lo = (std::min)(lo, v);
+                  hi = (std::max)(hi, v);
+               }
+            }
+         }
+         return {lo, hi};
+      }
+
+      std::vector<uint8_t> render() const { return render(default_color_scheme); }
+
+      std::vector<uint8_t> render(const auto& colors) const
+      {
+         std::vector<uint8_t> colorbuf(size_t(width) * height * 4);
+         PLOTZ_COUNT_ALLOCATED(colorbuf.size());
+         render_into({colorbuf.data(), width, height}, colors);
+         return colorbuf;
+      }
+
+      // Render into caller owned pixels, out must be width x height
+      void render_into(const image_view& out) const { render_into(out, default_color_scheme); }
+
+      void render_into(const image_view& out, const auto& colors) const
+      {
+         const auto [min_value, max_value] = extrema();
+         const float offset = min_value < 0.0f ? min_value : 0.0f;
+         const float range = max_value - offset;
+         render_normalized_into(out, palette(colors), offset, 1.0f / (range > 0.0f ? range : 1.0f));
+      }
+
+      void render_saturated_into(const image_view& out, const auto& colors, float saturation) const
+      {
+         assert(saturation > 0.0f);
+         render_normalized_into(out, palette(colors), 0.0f, 1.0f / saturation);
+      }
+
+      // Colors each value by clamp((v - offset) * scale, 0, 1)
+      void render_normalized_into(const image_view& out, const palette& colors, float offset, float scale) const
+      {
+         assert(out.width == width && out.height == height);
+         PLOTZ_SCOPE(render, "magnitude_view::render_normalized_into");
+
+         if (stride == width && out.packed()) {
+            colorize(data, size_t(width) * height, offset, scale, colors, out.data);
+            return;
+         }
+         for (uint32_t y = 0; y < height; ++y) {
+            colorize(row(y), width, offset, scale, colors, out.row(y));
+         }
+      }
+   };
+
+   template <plot_value T>
+   magnitude_view(const T*, uint32_t, uint32_t, size_t = 0) -> magnitude_view<T>;
+
+   template <plot_value T, size_t Extent>
+   magnitude_view(std::span<T, Extent>, uint32_t, uint32_t) -> magnitude_view<std::remove_const_t<T>>;
+}
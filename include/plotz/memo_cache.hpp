@@ -0,0 +1,68 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace plotz
+{
+   // Thread safe memoizer holding at most `capacity` values, the least recently used one is evicted when full
+   // Compare must be transparent: lookups take any key view it can compare with Key, so hits copy nothing and the
+   // owning Key(view) is only built when a value is inserted. Values are handed out as shared pointers, so a value
+   // evicted while a caller still holds it stays alive until released.
+   template <class Key, class Value, class Compare = std::less<>>
+   struct memo_cache final
+   {
+      explicit memo_cache(size_t capacity_in) noexcept : capacity(capacity_in ? capacity_in : 1) {}
+
+      memo_cache(const memo_cache&) = delete;
+      memo_cache& operator=(const memo_cache&) = delete;
+
+      // Returns the value for key, calling make() to build it on a miss
+      template <class KeyView, class Make>
+      std::shared_ptr<const Value> get(const KeyView& key, Make&& make)
+      {
+         std::lock_guard lock(mutex);
+         if (auto it = entries.find(key); it != entries.end()) {
+            it->second.last_used = ++tick;
+            return it->second.value;
+         }
+
+         if (entries.size() >= capacity) {
+            auto oldest = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+               if (it->second.last_used < oldest->second.last_used) oldest = it;
+            }
+            entries.erase(oldest);
+         }
+         auto value = std::make_shared<const Value>(make());
+         entries.emplace(Key(key), entry{value, ++tick});
+         return value;
+      }
+
+      size_t size() const
+      {
+         std::lock_guard lock(mutex);
+         return entries.size();
+      }
+
+     private:
+      struct entry final
+      {
+         std::shared_ptr<const Value> value;
+         uint64_t last_used{};
+      };
+
+      size_t capacity{};
+      uint64_t tick{};
+      mutable std::mutex mutex;
+      std::map<Key, entry, Compare> entries;
+   };
+}
@@ -0,0 +1,62 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace plotz
+{
+   // Thread count used when a caller requests 0 threads
+   inline size_t default_thread_count() noexcept { return (std::max)(1u, std::thread::hardware_concurrency()); }
+
+   // Splits [0, count) into at most `threads` contiguous ranges and calls f(begin, end) for each range
+   // The calling thread processes the first range. The first exception thrown by any range is rethrown.
+   template <class F>
+   void parallel_for(size_t count, size_t threads, F&& f)
+   {
+      if (count == 0) return;
+      if (threads == 0) threads = default_thread_count();
+      threads = (std::min)(threads, count);
+
+      if (threads == 1) {
+         f(size_t(0), count);
+         return;
+      }
+
+      const size_t chunk = count / threads;
+      const size_t remainder = count % threads;
+      auto range_begin = [&](size_t i) { return i * chunk + (std::min)(i, remainder); };
+
+      std::vector<std::exception_ptr> errors(threads);
+      {
+         std::vector<std::jthread> workers;
+         workers.reserve(threads - 1);
+         for (size_t i = 1; i < threads; ++i) {
+            workers.emplace_back([&, i] {
+               try {
+                  f(range_begin(i), range_begin(i + 1));
+               }
+               catch (...) {
+                  errors[i] = std::current_exception();
+               }
+            });
+         }
+
+         try {
+            f(range_begin(0), range_begin(1));
+         }
+         catch (...) {
+            errors[0] = std::current_exception();
+         }
+      } // join
+
+      for (auto& e : errors) {
+         if (e) std::rethrow_exception(e);
+      }
+   }
+}
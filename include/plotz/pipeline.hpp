@@ -0,0 +1,159 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "plotz/color_scheme.hpp"
+#include "plotz/colorize.hpp"
+#include "plotz/heatmap.hpp"
+#include "plotz/image.hpp"
+#include "plotz/magnitude.hpp"
+#include "plotz/magnitude_view.hpp"
+#include "plotz/render_text.hpp"
+#include "plotz/write_png.hpp"
+
+namespace plotz
+{
+   // Renders, annotates and encodes a frame one band of rows at a time
+   // Each band is colorized into a small reused buffer, overlapping text is drawn on it and it is handed to the
+   // encoder while still in cache. The full RGBA frame is never materialized, so a frame costs about one pass over
+   // memory instead of separate render, text and encode passes.
+   struct band_pipeline final
+   {
+      band_pipeline(uint32_t width_in, uint32_t height_in, uint32_t band_rows_in = 0)
+         : width(width_in),
+           height(height_in),
+           band_rows(band_rows_in ? band_rows_in : default_band_rows(width_in))
+      {}
+
+      uint32_t width{}, height{};
+      uint32_t band_rows{}; // Rows per band
+      std::vector<text_placement> overlays; // Drawn over every frame
+
+      // Rows per band so a band holds about 256 KiB of RGBA, comfortably inside L2
+      static uint32_t default_band_rows(uint32_t width) noexcept
+      {
+         static constexpr size_t band_bytes = 256 * 1024;
+         return uint32_t((std::max<size_t>)(1, band_bytes / ((std::max<size_t>)(width, 1) * 4)));
+      }
+
+      // Adds text placed like render_text_to_image
+      void add_text(const std::string& text, const std::string& font_filename, float font_size_percentage,
+                    const std::array<uint8_t, 4>& text_color = {})
+      {
+         overlays.push_back(place_text(width, height, text, font_filename, font_size_percentage, text_color));
+      }
+
+      void clear_text() noexcept { overlays.clear(); }
+
+      // Calls render(band, y0) to fill image rows [y0, y0 + band.height), draws the overlays and passes the band to
+      // consume(band), top to bottom
+      template <class Render, class Consume>
+      void run(Render&& render, Consume&& consume)
+      {
+         band.resize(width, (std::min)(band_rows, height));
+         for (uint32_t y0 = 0; y0 < height; y0 += band_rows) {
+            const image_view view{band.data.data(), width, (std::min)(band_rows, height - y0)};
+            render(view, y0);
+            for (const auto& text : overlays) text.draw_band(view, y0);
+            consume(view);
+         }
+      }
+
+      // Colorizes packed width x height values with clamp((v - offset) * scale, 0, 1)
+      template <plot_value T>
+      void run(const T* values, float offset, float scale, const palette& colors, auto&& consume)
+      {
+         run(
+            [&](const image_view& view, uint32_t y0) {
+               colorize(values + size_t(y0) * width, offset, scale, colors, view);
+            },
+            consume);
+      }
+
+      template <plot_value T>
+      void write_png(png_writer& writer, const T* values, float offset, float scale, const palette& colors)
+      {
+         run(values, offset, scale, colors, [&](const image_view& view) { writer.write_rows(view); });
+      }
+
+      template <plot_value T>
+      void write_png(const std::string& filename, const T* values, float offset, float scale, const palette& colors,
+                     const png_options& options = {})
+      {
+         png_writer writer(filename, width, height, options);
+         write_png(writer, values, offset, scale, colors);
+         writer.finish();
+      }
+
+      // Saturated like heatmap::render
+      template <heat_value T>
+      void write_png(const std::string& filename, const basic_heatmap<T>& map, const png_options& options = {})
+      {
+         write_png(filename, map, default_color_scheme, options);
+      }
+
+      template <heat_value T>
+      void write_png(const std::string& filename, const basic_heatmap<T>& map, const auto& colors,
+                     const png_options& options = {})
+      {
+         assert(map.width == width && map.height == height);
+         const float max_value = map.current_max_heat();
+         const float saturation = max_value > 0.0f ? max_value : 1.0f;
+         write_png(filename, map.buffer.data(), 0.0f, 1.0f / (saturation * heat_unit<T>), palette(colors), options);
+      }
+
+      // Normalized like magnitude::render
+      template <plot_value T>
+      void write_png(const std::string& filename, const basic_magnitude<T>& map, const png_options& options = {})
+      {
+         write_png(filename, map, default_color_scheme, options);
+      }
+
+      template <plot_value T>
+      void write_png(const std::string& filename, const basic_magnitude<T>& map, const auto& colors,
+                     const png_options& options = {})
+      {
+         assert(map.width == width && map.height == height);
+         const auto [offset, scale] = map.normalization();
+         write_png(filename, map.buffer.data(), offset, scale, palette(colors), options);
+      }
+
+      // Normalized like magnitude_view::render_into, row strides of the view are honored
+      template <plot_value T>
+      void write_png(const std::string& filename, const magnitude_view<T>& view, const png_options& options = {})
+      {
+         write_png(filename, view, default_color_scheme, options);
+      }
+
+      template <plot_value T>
+      void write_png(const std::string& filename, const magnitude_view<T>& view, const auto& colors,
+                     const png_options& options = {})
+      {
+         assert(view.width == width && view.height == height);
+         const auto [min_value, max_value] = view.extrema();
+         const float offset = min_value < 0.0f ? min_value : 0.0f;
+         const float range = max_value - offset;
+         const palette pal(colors);
+         const float scale = 1.0f / (range > 0.0f ? range : 1.0f);
+
+         png_writer writer(filename, width, height, options);
+         run(
+            [&](const image_view& band_view, uint32_t y0) {
+               view.subview(0, y0, width, band_view.height).render_normalized_into(band_view, pal, offset, scale);
+            },
+            [&](const image_view& band_view) { writer.write_rows(band_view); });
+         writer.finish();
+      }
+
+     private:
+      image band; // Reused across bands and frames
+   };
+}
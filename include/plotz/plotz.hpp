@@ -32,7 +32,20 @@
 
 #pragma once
 
+#include "plotz/decaying_heatmap.hpp"
+#include "plotz/density.hpp"
 #include "plotz/heatmap.hpp"
+#include "plotz/image.hpp"
+#include "plotz/image_writer.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/legend.hpp"
 #include "plotz/magnitude.hpp"
+#include "plotz/magnitude_view.hpp"
+#include "plotz/memo_cache.hpp"
+#include "plotz/pipeline.hpp"
+#include "plotz/pyramid.hpp"
+#include "plotz/sink.hpp"
+#include "plotz/sparse_heatmap.hpp"
 #include "plotz/write_png.hpp"
+#include "plotz/write_png_parallel.hpp"
 #include "plotz/render_text.hpp"
@@ -0,0 +1,321 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "plotz/color_scheme.hpp"
+#include "plotz/colorize.hpp"
+#include "plotz/heatmap.hpp"
+#include "plotz/image.hpp"
+#include "plotz/magnitude.hpp"
+#include "plotz/write_png.hpp"
+
+namespace plotz
+{
+   // Receives every tile a pyramid build re-renders, the view is only valid during the call
+   using tile_callback = std::function<void(uint32_t z, uint32_t x, uint32_t y, const image_view& tile)>;
+
+   // Writes tiles in the XYZ layout, directory/z/x/y.png
+   inline tile_callback png_tile_directory(std::string directory, png_options options = {})
+   {
+      return [directory = std::move(directory), options](uint32_t z, uint32_t x, uint32_t y, const image_view& tile) {
+         const std::string column = std::format("{}/{}/{}", directory, z, x);
+         std::filesystem::create_directories(column);
+         write_png(std::format("{}/{}.png", column, y), tile, options);
+      };
+   }
+
+   // Multi-resolution XYZ tile pyramid for slippy map viewers
+   // The highest zoom level holds the data at full resolution. Each lower level halves the previous one by
+   // averaging 2x2 blocks of the float values, so colors are assigned after downsampling rather than by scaling
+   // RGBA output. Every level is colorized with the full resolution offset and scale.
+   // Zoom z is the 2^z x 2^z tile grid XYZ clients expect, with the data anchored at the top left of tile (0, 0) and
+   // zoom 0 a single tile. Pixels beyond the data extent are transparent, and tiles entirely beyond it are emitted
+   // once, unless emit_padding_tiles is off and clients treat the missing tiles as empty.
+   // Only tiles whose values changed are downsampled and hashed again: heatmap builds take the rows written since
+   // the previous build from the heatmap's dirty spans, other sources count every tile as changed. A tile is emitted
+   // when its hash, the scale or the palette changed.
+   struct tile_pyramid final
+   {
+      explicit tile_pyramid(uint32_t tile_size_in = 256) noexcept : tile_size(tile_size_in) { assert(tile_size > 0); }
+
+      uint32_t tile_size{};
+      bool emit_padding_tiles = true;
+
+      // Zoom level holding full resolution data, valid after a build
+      uint32_t max_zoom() const noexcept { return uint32_t(levels.empty() ? 0 : levels.size() - 1); }
+
+      // Forgets the tile hashes, so the next build emits every tile
+      void invalidate() noexcept
+      {
+         forget_hashes();
+         for (auto& level : levels) level.padding_emitted = false;
+      }
+
+      // Builds from width x height values, colorized with clamp((v - offset) * scale, 0, 1)
+      // Every tile is downsampled and hashed, since nothing tells which values changed
+      // Returns the number of tiles passed to emit
+      size_t build(std::span<const float> data, uint32_t width, uint32_t height, float offset, float scale,
+                   const palette& colors, const tile_callback& emit)
+      {
+         assert(data.size() == size_t(width) * height);
+         if (width == 0 || height == 0) return 0;
+
+         resize_levels(width, height);
+         source = nullptr;
+         mark_all_tiles();
+         return build_levels(data.data(), offset, scale, colors, emit);
+      }
+
+      // Only revisits tiles overlapping rows written since the previous build, through map.take_dirty_rows()
+      // Mixing this with map.render_dirty, which consumes the same spans, makes every build a full one
+      size_t build(heatmap& map, const tile_callback& emit) { return build(map, default_color_scheme, emit); }
+
+      size_t build(heatmap& map, const auto& colors, const tile_callback& emit)
+      {
+         if (map.width == 0 || map.height == 0) return 0;
+
+         const bool reshaped = resize_levels(map.width, map.height);
+         auto& top = levels.back();
+         const bool tracked = map.take_dirty_rows([&](uint32_t y, uint32_t x_begin, uint32_t x_end) {
+            mark_tiles(top, y / tile_size, x_begin / tile_size, (x_end - 1) / tile_size);
+         });
+         if (!tracked || reshaped || source != &map) mark_all_tiles();
+         source = &map;
+
+         const float max_value = map.current_max_heat();
+         const float saturation = max_value > 0.0f ? max_value : 1.0f;
+         return build_levels(map.buffer.data(), 0.0f, 1.0f / saturation, palette(colors), emit);
+      }
+
+      // A const heatmap cannot hand over its dirty spans, so every tile is revisited
+      size_t build(const heatmap& map, const tile_callback& emit)
+      {
+         return build(map, default_color_scheme, emit);
+      }
+
+      size_t build(const heatmap& map, const auto& colors, const tile_callback& emit)
+      {
+         const float max_value = map.current_max_heat();
+         const float saturation = max_value > 0.0f ? max_value : 1.0f;
+         return build(map.buffer, map.width, map.height, 0.0f, 1.0f / saturation, palette(colors), emit);
+      }
+
+      // Normalizes like magnitude::render, without modifying the magnitude
+      size_t build(const magnitude& map, const tile_callback& emit)
+      {
+         return build(map, default_color_scheme, emit);
+      }
+
+      size_t build(const magnitude& map, const auto& colors, const tile_callback& emit)
+      {
+         const auto [offset, scale] = map.normalization();
+         return build(map.buffer, map.width, map.height, offset, scale, palette(colors), emit);
+      }
+
+     private:
+      struct level_data final
+      {
+         uint32_t width{}, height{};
+         uint32_t tiles_x{}, tiles_y{}; // Tiles holding data, the rest of the 2^z x 2^z grid is padding
+         std::vector<float> values; // Empty for the full resolution level, which reads the caller's data
+         std::vector<uint64_t> hashes; // Per tile, 0 means never emitted
+         std::vector<uint8_t> dirty; // Per tile, values changed since the previous build
+         bool padding_emitted{};
+      };
+
+      static constexpr uint64_t hash_seed = 0xcbf29ce484222325ull;
+
+      std::vector<level_data> levels; // Indexed by zoom
+      uint64_t style_hash{};
+      const void* source{}; // Heatmap whose dirty spans the previous build took
+      image tile_image;
+
+      static uint64_t hash_bytes(uint64_t h, const void* data, size_t size) noexcept
+      {
+         // FNV-1a over 8 byte words, with a final mix of the tail
+         const auto* bytes = static_cast<const uint8_t*>(data);
+         size_t i = 0;
+         for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            h = (h ^ word) * 0x100000001b3ull;
+         }
+         for (; i < size; ++i) h = (h ^ bytes[i]) * 0x100000001b3ull;
+         return h;
+      }
+
+      void forget_hashes() noexcept
+      {
+         for (auto& level : levels) std::fill(level.hashes.begin(), level.hashes.end(), uint64_t(0));
+         style_hash = 0;
+      }
+
+      // Returns true when the levels were reallocated, which leaves every tile to be rebuilt
+      bool resize_levels(uint32_t width, uint32_t height)
+      {
+         uint32_t zooms = 1;
+         for (uint32_t extent = (std::max)(width, height); extent > tile_size; extent = (extent + 1) / 2) ++zooms;
+
+         if (levels.size() == zooms && levels.back().width == width && levels.back().height == height) return false;
+
+         levels.assign(zooms, {});
+         uint32_t w = width, h = height;
+         for (uint32_t z = zooms; z-- > 0;) {
+            auto& level = levels[z];
+            level.width = w;
+            level.height = h;
+            level.tiles_x = (w + tile_size - 1) / tile_size;
+            level.tiles_y = (h + tile_size - 1) / tile_size;
+            level.hashes.assign(size_t(level.tiles_x) * level.tiles_y, 0);
+            level.dirty.assign(level.hashes.size(), 1);
+            if (z + 1 < zooms) level.values.resize(size_t(w) * h);
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+         }
+         style_hash = 0;
+         return true;
+      }
+
+      // Marks tiles [tx_begin, tx_end] of tile row ty
+      static void mark_tiles(level_data& level, uint32_t ty, uint32_t tx_begin, uint32_t tx_end) noexcept
+      {
+         uint8_t* row = level.dirty.data() + size_t(ty) * level.tiles_x;
+         std::fill(row + tx_begin, row + tx_end + 1, uint8_t(1));
+      }
+
+      // Lower levels follow from the full resolution one as they are built
+      void mark_all_tiles() noexcept
+      {
+         auto& top = levels.back();
+         std::fill(top.dirty.begin(), top.dirty.end(), uint8_t(1));
+      }
+
+      size_t build_levels(const float* data, float offset, float scale, const palette& colors,
+                          const tile_callback& emit)
+      {
+         // Restyling changes every tile
+         uint64_t style = hash_bytes(hash_seed, &offset, sizeof(offset));
+         style = hash_bytes(style, &scale, sizeof(scale));
+         style = hash_bytes(style, colors.colors.data(), colors.size() * sizeof(uint32_t));
+         if (style != style_hash) {
+            forget_hashes();
+            style_hash = style;
+         }
+
+         tile_image.resize(tile_size, tile_size);
+         size_t emitted = 0;
+         for (uint32_t z = max_zoom() + 1; z-- > 0;) {
+            auto& level = levels[z];
+            const float* values = data;
+            if (z < max_zoom()) {
+               // A tile covers 2x2 tiles of the next finer level
+               const auto& finer = levels[z + 1];
+               const float* finer_values = z + 1 < max_zoom() ? finer.values.data() : data;
+               for (uint32_t ty = 0; ty < finer.tiles_y; ++ty) {
+                  for (uint32_t tx = 0; tx < finer.tiles_x; ++tx) {
+                     if (finer.dirty[size_t(ty) * finer.tiles_x + tx]) mark_tiles(level, ty / 2, tx / 2, tx / 2);
+                  }
+               }
+               for (uint32_t ty = 0; ty < level.tiles_y; ++ty) {
+                  for (uint32_t tx = 0; tx < level.tiles_x; ++tx) {
+                     if (!level.dirty[size_t(ty) * level.tiles_x + tx]) continue;
+                     downsample(finer_values, finer.width, finer.height, level, tx * tile_size, ty * tile_size,
+                                tile_size);
+                  }
+               }
+               values = level.values.data();
+            }
+            emitted += emit_level(z, values, offset, scale, colors, emit);
+         }
+         for (auto& level : levels) std::fill(level.dirty.begin(), level.dirty.end(), uint8_t(0));
+         return emitted;
+      }
+
+      // Averages 2x2 blocks into the size x size region of dst at (x0, y0), clipped to dst
+      // Blocks cut by an odd edge average the values they contain
+      static void downsample(const float* src, uint32_t src_w, uint32_t src_h, level_data& dst, uint32_t x0,
+                             uint32_t y0, uint32_t size)
+      {
+         const uint32_t x1 = (std::min)(dst.width, x0 + size);
+         const uint32_t y1 = (std::min)(dst.height, y0 + size);
+         for (uint32_t y = y0; y < y1; ++y) {
+            const float* row0 = src + size_t(2 * y) * src_w;
+            const float* row1 = (2 * y + 1 < src_h) ? row0 + src_w : nullptr;
+            float* out = dst.values.data() + size_t(y) * dst.width;
+            for (uint32_t x = x0; x < x1; ++x) {
+               const uint32_t sx = 2 * x;
+               const bool has_right = sx + 1 < src_w;
+               float sum = row0[sx] + (has_right ? row0[sx + 1] : 0.0f);
+               uint32_t count = has_right ? 2 : 1;
+               if (row1) {
+                  sum += row1[sx] + (has_right ? row1[sx + 1] : 0.0f);
+                  count *= 2;
+               }
+               out[x] = sum / float(count);
+            }
+         }
+      }
+
+      size_t emit_level(uint32_t z, const float* values, float offset, float scale, const palette& colors,
+                        const tile_callback& emit)
+      {
+         auto& level = levels[z];
+         const image_view view = tile_image.view();
+         size_t emitted = 0;
+         for (uint32_t ty = 0; ty < level.tiles_y; ++ty) {
+            for (uint32_t tx = 0; tx < level.tiles_x; ++tx) {
+               const size_t index = size_t(ty) * level.tiles_x + tx;
+               auto& stored = level.hashes[index];
+               if (!level.dirty[index] && stored != 0) continue;
+
+               const uint32_t x0 = tx * tile_size;
+               const uint32_t y0 = ty * tile_size;
+               const uint32_t w = (std::min)(tile_size, level.width - x0);
+               const uint32_t h = (std::min)(tile_size, level.height - y0);
+
+               uint64_t hash = hash_seed;
+               for (uint32_t y = 0; y < h; ++y) {
+                  hash = hash_bytes(hash, values + size_t(y0 + y) * level.width + x0, w * sizeof(float));
+               }
+               hash |= 1; // Keep 0 for tiles that were never emitted
+               if (hash == stored) continue;
+               stored = hash;
+
+               if (w < tile_size || h < tile_size) std::fill(tile_image.data.begin(), tile_image.data.end(), 0);
+               for (uint32_t y = 0; y < h; ++y) {
+                  colorize(values + size_t(y0 + y) * level.width + x0, w, offset, scale, colors, view.row(y));
+               }
+               emit(z, tx, ty, view);
+               ++emitted;
+            }
+         }
+
+         // Padding tiles of the 2^z x 2^z grid, transparent whatever the data or style
+         if (emit_padding_tiles && !level.padding_emitted) {
+            std::fill(tile_image.data.begin(), tile_image.data.end(), 0);
+            const uint32_t grid = uint32_t(1) << z;
+            for (uint32_t ty = 0; ty < grid; ++ty) {
+               for (uint32_t tx = 0; tx < grid; ++tx) {
+                  if (tx < level.tiles_x && ty < level.tiles_y) continue;
+                  emit(z, tx, ty, view);
+                  ++emitted;
+               }
+            }
+            level.padding_emitted = true;
+         }
+         return emitted;
+      }
+   };
+}
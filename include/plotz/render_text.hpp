@@ -5,16 +5,216 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include <algorithm>
 #include <string>
 #include <stdexcept>
 #include <array>
 #include <format>
+#include <limits>
 #include <utility>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/simd.hpp"
+
+#if defined(PLOTZ_EMBEDDED_FONTS)
+#include "plotz/embedded_fonts.hpp"
+#endif
 
 namespace plotz
 {
+   // A rasterized glyph, cached so each (face, pixel size, codepoint) is rendered by FreeType only once
+   struct glyph final
+   {
+      int left{}, top{}; // Bitmap offset from the pen position, top is measured upwards from the baseline
+      int advance_x{}, advance_y{}; // Pen advance in pixels
+      uint32_t width{}, rows{}; // Bitmap dimensions
+      std::vector<uint8_t> bitmap; // width * rows coverage values
+   };
+
+   // A string laid out at one pixel size
+   struct text_layout final
+   {
+      struct placed_glyph final
+      {
+         std::shared_ptr<const glyph> g; // Shared with the glyph cache, so layouts outlive the cache and its thread
+         int pen_x{}, pen_y{}; // Pen position relative to the start of the string
+      };
+
+      std::vector<placed_glyph> glyphs;
+      int width{}; // Sum of the advances
+      int height{}; // Maximum ascent plus maximum descent
+   };
+
+   struct glyph_key final
+   {
+      FT_Face face{};
+      uint32_t pixel_size{};
+      uint32_t codepoint{};
+
+      bool operator==(const glyph_key&) const = default;
+   };
+
+   struct layout_key final
+   {
+      FT_Face face{};
+      uint32_t pixel_size{};
+      std::string text;
+
+      bool operator==(const layout_key&) const = default;
+   };
+
+   struct text_cache_hash final
+   {
+      static size_t combine(size_t seed, size_t v) noexcept
+      {
+         return seed ^ (v + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+      }
+
+      size_t operator()(const glyph_key& k) const noexcept
+      {
+         size_t h = std::hash<const void*>{}(k.face);
+         h = combine(h, k.pixel_size);
+         return combine(h, k.codepoint);
+      }
+
+      size_t operator()(const layout_key& k) const noexcept
+      {
+         size_t h = std::hash<const void*>{}(k.face);
+         h = combine(h, k.pixel_size);
+         return combine(h, std::hash<std::string>{}(k.text));
+      }
+   };
+
+   // Font file bytes registered for every thread, see register_font_memory and register_font_mapped
+   struct font_source final
+   {
+      std::span<const uint8_t> bytes;
+      std::shared_ptr<const void> owner; // Keeps bytes alive, empty for static data
+   };
+
+   // Process wide, thread safe map of font names to in-memory font data
+   // Font file paths rendered by name are mapped on first use and kept here too, shared by every thread's faces.
+   // Fonts compiled in with the plotz_EMBED_FONTS CMake option are registered under their file stem,
+   // e.g. "RobotoMono-SemiBold".
+   struct font_registry final
+   {
+      font_registry()
+      {
+#if defined(PLOTZ_EMBEDDED_FONTS)
+         for (const auto& font : embedded_fonts::fonts) {
+            sources[font.name] = std::make_shared<const font_source>(font_source{{font.data, font.size}, {}});
+         }
+#endif
+      }
+
+      void add(const std::string& name, font_source source)
+      {
+         std::lock_guard lock{mutex};
+         sources[name] = std::make_shared<const font_source>(std::move(source));
+      }
+
+      std::shared_ptr<const font_source> find(const std::string& name) const
+      {
+         std::lock_guard lock{mutex};
+         auto it = sources.find(name);
+         return it == sources.end() ? nullptr : it->second;
+      }
+
+      // Returns the source registered under name, registering load() under it first if there is none
+      // Loading holds the lock, so concurrent first uses load a font once
+      template <class Load>
+      std::shared_ptr<const font_source> find_or_add(const std::string& name, Load&& load)
+      {
+         std::lock_guard lock{mutex};
+         auto& source = sources[name];
+         if (!source) {
+            try {
+               source = std::make_shared<const font_source>(load());
+            }
+            catch (...) {
+               sources.erase(name);
+               throw;
+            }
+         }
+         return source;
+      }
+
+     private:
+      mutable std::mutex mutex;
+      std::unordered_map<std::string, std::shared_ptr<const font_source>> sources;
+   };
+
+   inline font_registry font_sources;
+
+   // Register font data under `name`, usable as the font name for render_text_to_image from any thread
+   // Register before the name is first used, threads that already opened a face keep it.
+   // The bytes must stay valid for the life of the program, e.g. a font embedded in the binary.
+   inline void register_font_memory(const std::string& name, std::span<const uint8_t> bytes)
+   {
+      font_sources.add(name, {bytes, {}});
+   }
+
+   // Register font data under `name`, taking ownership of the bytes
+   inline void register_font_memory(const std::string& name, std::vector<uint8_t> bytes)
+   {
+      auto owner = std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+      font_sources.add(name, {{owner->data(), owner->size()}, owner});
+   }
+
+   // Font file bytes, memory mapped where the platform allows it
+   inline font_source map_font_file(const std::string& font_filename)
+   {
+#if defined(_WIN32)
+      std::ifstream in(font_filename, std::ios::binary);
+      if (!in) {
+         throw std::runtime_error(std::format("Failed to open font: {}", font_filename));
+      }
+      auto owner = std::make_shared<const std::vector<uint8_t>>(std::istreambuf_iterator<char>(in),
+                                                                std::istreambuf_iterator<char>{});
+      return {{owner->data(), owner->size()}, owner};
+#else
+      const int fd = open(font_filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+         throw std::runtime_error(std::format("Failed to open font: {}", font_filename));
+      }
+      struct stat st{};
+      if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+         close(fd);
+         throw std::runtime_error(std::format("Failed to read font: {}", font_filename));
+      }
+      const size_t size = size_t(st.st_size);
+      void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (mapped == MAP_FAILED) {
+         throw std::runtime_error(std::format("Failed to map font: {}", font_filename));
+      }
+      std::shared_ptr<const void> owner(mapped, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+      return {{static_cast<const uint8_t*>(mapped), size}, std::move(owner)};
+#endif
+   }
+
+   // Register a font file under `name`, memory mapping it instead of reading it
+   inline void register_font_mapped(const std::string& name, const std::string& font_filename)
+   {
+      font_sources.add(name, map_font_file(font_filename));
+   }
+
    struct free_type_context {
       std::shared_ptr<FT_Library> ft = []{
          FT_Library* ft_lib = new FT_Library;
@@ -34,19 +234,26 @@ namespace plotz
       std::unordered_map<std::string, std::shared_ptr<FT_Face>> faces; // font name to font faces
 
       // Load and register a font face
+      // Names registered with register_font_memory/register_font_mapped are opened from memory, anything else is
+      // treated as a font file path, mapped once and registered under it so other threads open the same bytes
       void register_font(const std::string& font_filename) {
          if (faces.find(font_filename) == faces.end()) {
+            auto source = font_sources.find_or_add(font_filename, [&] { return map_font_file(font_filename); });
             FT_Face* face = new FT_Face;
-            if (FT_New_Face(*ft, font_filename.c_str(), 0, face)) {
+            const FT_Error error =
+               FT_New_Memory_Face(*ft, source->bytes.data(), FT_Long(source->bytes.size()), 0, face);
+            if (error) {
                delete face; // Clean up if face creation fails
                throw std::runtime_error(std::format("Failed to load font: {}", font_filename));
             }
-            faces[font_filename] = std::shared_ptr<FT_Face>(face, [](FT_Face* face){
+            // The deleter holds the font source, memory faces read from it until they are closed
+            faces[font_filename] = std::shared_ptr<FT_Face>(face, [source](FT_Face* face) mutable {
                if (face) {
                   FT_Done_Face(*face);
                   delete face;
                   face = nullptr;
                }
+               source.reset(); // Release the font data only after the face is closed
             });
          }
       }
@@ -59,41 +266,150 @@ namespace plotz
          }
          return *(it->second); // Dereference shared_ptr to return FT_Face
       }
-   };
 
-   // Inline global instance of FreeTypeContext
-   inline free_type_context ft_context;
+      std::unordered_map<glyph_key, std::shared_ptr<const glyph>, text_cache_hash> glyphs; // Rasterized glyph cache
+      std::unordered_map<layout_key, text_layout, text_cache_hash> layouts; // Laid out string cache
+      size_t max_cached_layouts = 4096; // The layout cache is emptied when it grows past this size
+      size_t max_cached_glyphs = 16384; // Likewise for the glyph cache, layouts keep their glyphs alive
 
-   inline std::pair<int, int> calculate_text_dimensions(FT_Face face, const std::string& text)
-   {
-      int width = 0;
-      int max_ascent = 0;
-      int max_descent = 0;
+      // Get a rasterized glyph, rendering it with FreeType on first use
+      const glyph& get_glyph(FT_Face face, uint32_t pixel_size, uint32_t codepoint)
+      {
+         return *shared_glyph(face, pixel_size, codepoint);
+      }
 
-      for (char c : text) {
-         if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-            std::cerr << "Failed to load Glyph for character: " << c << "\n";
-            continue;
+      // The cached glyph itself, kept alive by the returned pointer even after clear_caches or thread exit
+      std::shared_ptr<const glyph> shared_glyph(FT_Face face, uint32_t pixel_size, uint32_t codepoint)
+      {
+         const glyph_key key{face, pixel_size, codepoint};
+         if (auto it = glyphs.find(key); it != glyphs.end()) {
+            return it->second;
          }
 
-         FT_GlyphSlot g = face->glyph;
+         if (glyphs.size() >= max_cached_glyphs) glyphs.clear();
+
+         FT_Set_Pixel_Sizes(face, 0, pixel_size);
+         if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER)) {
+            throw std::runtime_error(std::format("Failed to load Glyph for character: {}", codepoint));
+         }
 
-         // Accumulate the advance width
-         width += g->advance.x >> 6; // Convert from 1/64th pixels to pixels
+         const FT_GlyphSlot slot = face->glyph;
+         glyph g{.left = slot->bitmap_left,
+                 .top = slot->bitmap_top,
+                 .advance_x = int(slot->advance.x >> 6), // Convert from 1/64th pixels to pixels
+                 .advance_y = int(slot->advance.y >> 6),
+                 .width = slot->bitmap.width,
+                 .rows = slot->bitmap.rows,
+                 .bitmap = {}};
+         g.bitmap.resize(size_t(g.width) * g.rows);
+         for (uint32_t row = 0; row < g.rows; ++row) {
+            // pitch may pad or flip rows, store them tightly packed top to bottom
+            const uint8_t* src = slot->bitmap.buffer + ptrdiff_t(row) * slot->bitmap.pitch;
+            if (slot->bitmap.pitch < 0) src = slot->bitmap.buffer + ptrdiff_t(g.rows - 1 - row) * -slot->bitmap.pitch;
+            std::copy_n(src, g.width, g.bitmap.data() + size_t(row) * g.width);
+         }
 
-         // Track maximum ascent and descent for vertical sizing
-         if (g->bitmap_top > max_ascent) max_ascent = g->bitmap_top;
+         return glyphs.emplace(key, std::make_shared<const glyph>(std::move(g))).first->second;
+      }
+
+      // Get the layout of a string, laying it out from cached glyphs on first use
+      const text_layout& layout_text(FT_Face face, uint32_t pixel_size, const std::string& text)
+      {
+         layout_key key{face, pixel_size, text};
+         if (auto it = layouts.find(key); it != layouts.end()) {
+            return it->second;
+         }
+
+         if (layouts.size() >= max_cached_layouts) layouts.clear();
+
+         text_layout layout;
+         layout.glyphs.reserve(text.size());
+         int pen_x = 0;
+         int pen_y = 0;
+         int max_ascent = 0;
+         int max_descent = 0;
+         for (char c : text) {
+            const auto shared = shared_glyph(face, pixel_size, static_cast<unsigned char>(c));
+            const glyph& g = *shared;
+            layout.glyphs.push_back({shared, pen_x, pen_y});
+            pen_x += g.advance_x;
+            pen_y += g.advance_y;
+
+            // Track maximum ascent and descent for vertical sizing
+            max_ascent = (std::max)(max_ascent, g.top);
+            max_descent = (std::max)(max_descent, int(g.rows) - g.top);
+         }
+         layout.width = pen_x;
+         layout.height = max_ascent + max_descent;
 
-         int descent = g->bitmap.rows - g->bitmap_top;
-         if (descent > max_descent) max_descent = descent;
+         return layouts.emplace(std::move(key), std::move(layout)).first->second;
       }
 
-      int height = max_ascent + max_descent;
-      return {width, height};
+      // Drop cached glyphs and layouts, e.g. after rendering a large one-off set of strings
+      void clear_caches() noexcept
+      {
+         layouts.clear();
+         glyphs.clear();
+      }
+   };
+
+   // Per thread instance of free_type_context
+   // FreeType libraries and faces must not be shared between threads, so each thread lazily gets its own library,
+   // faces and glyph caches. Font bytes are loaded once per process through font_sources, and each thread that
+   // renders text opens its own face over them on first use.
+   inline thread_local free_type_context ft_context;
+
+   // Dimensions of text laid out at pixel_size, independent of the size last set on the shared face
+   inline std::pair<int, int> calculate_text_dimensions(FT_Face face, uint32_t pixel_size, const std::string& text)
+   {
+      const auto& layout = ft_context.layout_text(face, pixel_size, text);
+      return {layout.width, layout.height};
    }
 
-   // Function to render text using FreeType with dynamic font size and color
-   inline void render_text_to_image(uint8_t* image, size_t img_width, size_t img_height, const std::string& text,
+   // Blends a glyph with its bitmap's top left corner at (x, y) onto image
+   // The glyph rectangle is clipped once, then whole rows are blended with SIMD
+   inline void blend_glyph(const image_view& image, const glyph& g, int x, int y,
+                           const std::array<uint8_t, 4>& color) noexcept
+   {
+      const int col_begin = (std::max)(0, -x);
+      const int col_end = (std::min)(int(g.width), int(image.width) - x);
+      const int row_begin = (std::max)(0, -y);
+      const int row_end = (std::min)(int(g.rows), int(image.height) - y);
+      if (col_begin >= col_end) return;
+
+      for (int row = row_begin; row < row_end; ++row) {
+         uint8_t* dst = image.row(uint32_t(y + row)) + size_t(x + col_begin) * 4;
+         const uint8_t* coverage = g.bitmap.data() + size_t(row) * g.width + col_begin;
+         simd::blend_row(dst, coverage, size_t(col_end - col_begin), color[0], color[1], color[2]);
+      }
+   }
+
+   // Text laid out at its position on an image, drawable a band of rows at a time
+   // Holds a copy of the layout sharing ownership of its glyphs, so it may be drawn on any thread, after the
+   // placing thread has exited or cleared its caches
+   struct text_placement final
+   {
+      text_layout layout;
+      int x{}, y{}; // Pen start, y is the baseline
+      int top{}, bottom{}; // Image rows [top, bottom) touched by glyph bitmaps
+      std::array<uint8_t, 4> color{};
+
+      // Draws the part of the text falling in image rows [y0, y0 + band.height) into band
+      void draw_band(const image_view& band, uint32_t y0) const noexcept
+      {
+         if (bottom <= int(y0) || top >= int(y0 + band.height)) return;
+         PLOTZ_SCOPE(text, "text_placement::draw_band");
+         for (const auto& placed : layout.glyphs) {
+            const glyph& g = *placed.g;
+            blend_glyph(band, g, x + placed.pen_x + g.left, y + placed.pen_y - g.top - int(y0), color);
+         }
+      }
+
+      void draw(const image_view& image) const noexcept { draw_band(image, 0); }
+   };
+
+   // Lays out text the way render_text_to_image places it on a width x height image
+   inline text_placement place_text(uint32_t img_width, uint32_t img_height, const std::string& text,
                                     const std::string& font_filename,
                                     float font_size_percentage, // Font size as a percentage of image height
                                     const std::array<uint8_t, 4>& text_color = {} // (RGB) alpha is ignored
@@ -109,65 +425,47 @@ namespace plotz
       // Ensure the percentage is reasonable (e.g., between 1% and 100%)
       font_size_percentage = std::clamp(font_size_percentage, 1.0f, 100.0f);
       int font_size = static_cast<int>(img_height * (font_size_percentage / 100.0f));
-      FT_Set_Pixel_Sizes(face, 0, font_size);
 
-      // Step 2: Calculate text dimensions
-      auto [text_width, text_height] = calculate_text_dimensions(face, text);
+      // Step 2: Lay out the text from cached glyphs
+      text_placement placement{.layout = ft_context.layout_text(face, font_size, text), .color = text_color};
+      const int text_width = placement.layout.width;
+      const int text_height = placement.layout.height;
 
       // Step 3: Calculate starting positions to center the text
-      int x_pos = int(img_width - text_width) / 2;
+      int x_pos = int(size_t(img_width) - text_width) / 2;
       int y_pos = int(img_height) - int(int(img_height + text_height) / 10);
 
       // Ensure starting positions are within the image boundaries
-      x_pos = (std::max)(0, x_pos);
-      y_pos = (std::min)(static_cast<int>(img_height), (std::max)(0, y_pos));
-
-      // Starting position
-      int pen_x = x_pos;
-      int pen_y = y_pos;
-
-      // Step 4: Render each character
-      for (char c : text) {
-         // Load character glyph
-         if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-            throw std::runtime_error(std::format("Failed to load Glyph for character: {}", c));
-         }
-
-         FT_GlyphSlot g = face->glyph;
-
-         // Render the glyph bitmap onto the image
-         for (unsigned int row = 0; row < g->bitmap.rows; ++row) {
-            for (unsigned int col = 0; col < g->bitmap.width; ++col) {
-               int x = pen_x + g->bitmap_left + col;
-               int y = pen_y - g->bitmap_top + row;
+      placement.x = (std::max)(0, x_pos);
+      placement.y = (std::min)(static_cast<int>(img_height), (std::max)(0, y_pos));
 
-               // Check boundaries
-               if (x < 0 || x >= static_cast<int>(img_width) || y < 0 || y >= static_cast<int>(img_height)) continue;
-
-               // Calculate the pixel index in the image buffer (assuming RGBA)
-               size_t pixel_index = (y * img_width + x) * 4;
-
-               // Get the glyph's alpha value
-               unsigned char glyph_alpha = g->bitmap.buffer[row * g->bitmap.width + col];
-
-               // Simple blending: use specified text color with glyph alpha
-               unsigned char alpha = glyph_alpha;
-               unsigned char inv_alpha = 255 - alpha;
-
-               // Existing image pixel (RGBA)
-               unsigned char* pixel = &image[pixel_index];
+      placement.top = (std::numeric_limits<int>::max)();
+      placement.bottom = (std::numeric_limits<int>::min)();
+      for (const auto& placed : placement.layout.glyphs) {
+         const int glyph_top = placement.y + placed.pen_y - placed.g->top;
+         placement.top = (std::min)(placement.top, glyph_top);
+         placement.bottom = (std::max)(placement.bottom, glyph_top + int(placed.g->rows));
+      }
+      return placement;
+   }
 
-               // Blend the text color with the existing pixel based on alpha
-               pixel[0] = (pixel[0] * inv_alpha + text_color[0] * alpha) / 255; // Red
-               pixel[1] = (pixel[1] * inv_alpha + text_color[1] * alpha) / 255; // Green
-               pixel[2] = (pixel[2] * inv_alpha + text_color[2] * alpha) / 255; // Blue
-               pixel[3] = (std::min)(255, pixel[3] + alpha); // Alpha
-            }
-         }
+   // Function to render text using FreeType with dynamic font size and color
+   inline void render_text_to_image(const image_view& image, const std::string& text, const std::string& font_filename,
+                                    float font_size_percentage, // Font size as a percentage of image height
+                                    const std::array<uint8_t, 4>& text_color = {} // (RGB) alpha is ignored
+   )
+   {
+      PLOTZ_SCOPE(text, "render_text_to_image");
+      place_text(image.width, image.height, text, font_filename, font_size_percentage, text_color).draw(image);
+   }
 
-         // Advance the pen position for the next character
-         pen_x += g->advance.x >> 6; // Convert from 1/64th pixels to pixels
-         pen_y += g->advance.y >> 6;
-      }
+   inline void render_text_to_image(uint8_t* image, size_t img_width, size_t img_height, const std::string& text,
+                                    const std::string& font_filename,
+                                    float font_size_percentage, // Font size as a percentage of image height
+                                    const std::array<uint8_t, 4>& text_color = {} // (RGB) alpha is ignored
+   )
+   {
+      render_text_to_image(image_view(image, uint32_t(img_width), uint32_t(img_height)), text, font_filename,
+                           font_size_percentage, text_color);
    }
 }
@@ -0,0 +1,378 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PLOTZ_SSE2 1
+#endif
+
+namespace plotz::simd
+{
+#if defined(__AVX2__)
+   inline float horizontal_max(__m256 v) noexcept
+   {
+      __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+      m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+      m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+      return _mm_cvtss_f32(m);
+   }
+#endif
+
+#if defined(PLOTZ_SSE2)
+   inline float horizontal_max(__m128 v) noexcept
+   {
+      v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+      v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+      return _mm_cvtss_f32(v);
+   }
+#endif
+
+#if defined(__AVX2__)
+   inline float horizontal_min(__m256 v) noexcept
+   {
+      __m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+      m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+      m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+      return _mm_cvtss_f32(m);
+   }
+#endif
+
+#if defined(PLOTZ_SSE2)
+   inline float horizontal_min(__m128 v) noexcept
+   {
+      v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+      v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+      return _mm_cvtss_f32(v);
+   }
+#endif
+
+   // dst[i] += src[i] * weight for n values, without tracking the maximum
+   inline void add_row(float* dst, const float* src, float weight, size_t n) noexcept
+   {
+      for (size_t i = 0; i < n; ++i) {
+         dst[i] += src[i] * weight;
+      }
+   }
+
+   // Returns {min, max} of n values, {max(), lowest()} when n == 0
+   inline std::pair<float, float> min_max(const float* data, size_t n) noexcept
+   {
+      float lo = (std::numeric_limits<float>::max)();
+      float hi = std::numeric_limits<float>::lowest();
+      size_t i = 0;
+
+#if defined(__AVX2__)
+      if (n >= 8) {
+         __m256 vlo = _mm256_set1_ps(lo);
+         __m256 vhi = _mm256_set1_ps(hi);
+         for (; i + 8 <= n; i += 8) {
+            const __m256 v = _mm256_loadu_ps(data + i);
+            vlo = _mm256_min_ps(vlo, v);
+            vhi = _mm256_max_ps(vhi, v);
+         }
+         lo = horizontal_min(vlo);
+         hi = horizontal_max(vhi);
+      }
+#endif
+
+#if defined(PLOTZ_SSE2)
+      if (n - i >= 4) {
+         __m128 vlo = _mm_set1_ps(lo);
+         __m128 vhi = _mm_set1_ps(hi);
+         for (; i + 4 <= n; i += 4) {
+            const __m128 v = _mm_loadu_ps(data + i);
+            vlo = _mm_min_ps(vlo, v);
+            vhi = _mm_max_ps(vhi, v);
+         }
+         lo = horizontal_min(vlo);
+         hi = horizontal_max(vhi);
+      }
+#elif defined(__ARM_NEON)
+      if (n >= 4) {
+         float32x4_t vlo = vdupq_n_f32(lo);
+         float32x4_t vhi = vdupq_n_f32(hi);
+         for (; i + 4 <= n; i += 4) {
+            const float32x4_t v = vld1q_f32(data + i);
+            vlo = vminq_f32(vlo, v);
+            vhi = vmaxq_f32(vhi, v);
+         }
+         lo = vminvq_f32(vlo);
+         hi = vmaxvq_f32(vhi);
+      }
+#endif
+
+      for (const float* end = data + n; data + i != end; ++i) {
+         lo = (std::min)(lo, data[i]);
+         hi = (std::max)(hi, data[i]);
+      }
+
+      return {lo, hi};
+   }
+
+   // Returns the maximum of n unsigned integers, 0 when n == 0
+   // 8, 16 and 32 bit values are scanned a register at a time, wider ones with the scalar loop
+   template <std::unsigned_integral T>
+   inline T max_unsigned(const T* data, size_t n) noexcept
+   {
+      T hi = 0;
+      size_t i = 0;
+
+      if constexpr (sizeof(T) <= 4) {
+#if defined(__AVX2__)
+         constexpr size_t lanes = 32 / sizeof(T);
+         if (n >= lanes) {
+            __m256i vhi = _mm256_setzero_si256();
+            for (; i + lanes <= n; i += lanes) {
+               const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+               if constexpr (sizeof(T) == 1) vhi = _mm256_max_epu8(vhi, v);
+               else if constexpr (sizeof(T) == 2) vhi = _mm256_max_epu16(vhi, v);
+               else vhi = _mm256_max_epu32(vhi, v);
+            }
+            alignas(32) T lane_values[lanes];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lane_values), vhi);
+            for (const T v : lane_values) hi = (std::max)(hi, v);
+         }
+#elif defined(PLOTZ_SSE2)
+         constexpr size_t lanes = 16 / sizeof(T);
+         if (n >= lanes) {
+            __m128i vhi = _mm_setzero_si128();
+            for (; i + lanes <= n; i += lanes) {
+               const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+               if constexpr (sizeof(T) == 1) {
+                  vhi = _mm_max_epu8(vhi, v);
+               }
+               else if constexpr (sizeof(T) == 2) {
+                  vhi = _mm_adds_epu16(_mm_subs_epu16(v, vhi), vhi); // max(v, vhi) without SSE4.1
+               }
+               else {
+                  // Unsigned compare by flipping the sign bits, then select
+                  const __m128i sign = _mm_set1_epi32(int32_t(0x80000000u));
+                  const __m128i greater = _mm_cmpgt_epi32(_mm_xor_si128(v, sign), _mm_xor_si128(vhi, sign));
+                  vhi = _mm_or_si128(_mm_and_si128(greater, v), _mm_andnot_si128(greater, vhi));
+               }
+            }
+            alignas(16) T lane_values[lanes];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lane_values), vhi);
+            for (const T v : lane_values) hi = (std::max)(hi, v);
+         }
+#elif defined(__ARM_NEON)
+         constexpr size_t lanes = 16 / sizeof(T);
+         if (n >= lanes) {
+            if constexpr (sizeof(T) == 1) {
+               const auto* p = reinterpret_cast<const uint8_t*>(data);
+               uint8x16_t vhi = vdupq_n_u8(0);
+               for (; i + lanes <= n; i += lanes) vhi = vmaxq_u8(vhi, vld1q_u8(p + i));
+               hi = T(vmaxvq_u8(vhi));
+            }
+            else if constexpr (sizeof(T) == 2) {
+               const auto* p = reinterpret_cast<const uint16_t*>(data);
+               uint16x8_t vhi = vdupq_n_u16(0);
+               for (; i + lanes <= n; i += lanes) vhi = vmaxq_u16(vhi, vld1q_u16(p + i));
+               hi = T(vmaxvq_u16(vhi));
+            }
+            else {
+               const auto* p = reinterpret_cast<const uint32_t*>(data);
+               uint32x4_t vhi = vdupq_n_u32(0);
+               for (; i + lanes <= n; i += lanes) vhi = vmaxq_u32(vhi, vld1q_u32(p + i));
+               hi = T(vmaxvq_u32(vhi));
+            }
+         }
+#endif
+      }
+
+      for (const T* end = data + n; data + i != end; ++i) hi = (std::max)(hi, data[i]);
+      return hi;
+   }
+
+   // dst[i] += src[i] * weight for n values
+   // Returns the maximum of the updated dst values, so callers never need to compare per pixel
+   inline float accumulate_row(float* dst, const float* src, float weight, size_t n) noexcept
+   {
+      float row_max = std::numeric_limits<float>::lowest();
+      size_t i = 0;
+
+#if defined(__AVX2__)
+      if (n >= 8) {
+         const __m256 w = _mm256_set1_ps(weight);
+         __m256 vmax = _mm256_set1_ps(row_max);
+         for (; i + 8 <= n; i += 8) {
+            const __m256 v = _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), w));
+            _mm256_storeu_ps(dst + i, v);
+            vmax = _mm256_max_ps(vmax, v);
+         }
+         row_max = horizontal_max(vmax);
+      }
+#endif
+
+#if defined(PLOTZ_SSE2)
+      if (n - i >= 4) {
+         const __m128 w = _mm_set1_ps(weight);
+         __m128 vmax = _mm_set1_ps(row_max);
+         for (; i + 4 <= n; i += 4) {
+            const __m128 v = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w));
+            _mm_storeu_ps(dst + i, v);
+            vmax = _mm_max_ps(vmax, v);
+         }
+         row_max = horizontal_max(vmax);
+      }
+#elif defined(__ARM_NEON)
+      if (n >= 4) {
+         const float32x4_t w = vdupq_n_f32(weight);
+         float32x4_t vmax = vdupq_n_f32(row_max);
+         for (; i + 4 <= n; i += 4) {
+            const float32x4_t v = vaddq_f32(vld1q_f32(dst + i), vmulq_f32(vld1q_f32(src + i), w));
+            vst1q_f32(dst + i, v);
+            vmax = vmaxq_f32(vmax, v);
+         }
+         row_max = vmaxvq_f32(vmax);
+      }
+#endif
+
+      for (; i < n; ++i) {
+         dst[i] += src[i] * weight;
+         row_max = (std::max)(row_max, dst[i]);
+      }
+
+      return row_max;
+   }
+
+   // accumulate_row for a compile time length that is a multiple of 8, e.g. padded fixed_stamp rows
+   // Whole registers only, the loop unrolls completely for short rows
+   template <size_t N>
+      requires(N % 8 == 0)
+   inline float accumulate_row_n(float* dst, const float* src, float weight) noexcept
+   {
+#if defined(__AVX2__)
+      const __m256 w = _mm256_set1_ps(weight);
+      __m256 vmax = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+      for (size_t i = 0; i < N; i += 8) {
+         const __m256 v = _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), w));
+         _mm256_storeu_ps(dst + i, v);
+         vmax = _mm256_max_ps(vmax, v);
+      }
+      return horizontal_max(vmax);
+#elif defined(PLOTZ_SSE2)
+      const __m128 w = _mm_set1_ps(weight);
+      __m128 vmax = _mm_set1_ps(std::numeric_limits<float>::lowest());
+      for (size_t i = 0; i < N; i += 4) {
+         const __m128 v = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w));
+         _mm_storeu_ps(dst + i, v);
+         vmax = _mm_max_ps(vmax, v);
+      }
+      return horizontal_max(vmax);
+#elif defined(__ARM_NEON)
+      const float32x4_t w = vdupq_n_f32(weight);
+      float32x4_t vmax = vdupq_n_f32(std::numeric_limits<float>::lowest());
+      for (size_t i = 0; i < N; i += 4) {
+         const float32x4_t v = vaddq_f32(vld1q_f32(dst + i), vmulq_f32(vld1q_f32(src + i), w));
+         vst1q_f32(dst + i, v);
+         vmax = vmaxq_f32(vmax, v);
+      }
+      return vmaxvq_f32(vmax);
+#else
+      float row_max = std::numeric_limits<float>::lowest();
+      for (size_t i = 0; i < N; ++i) {
+         dst[i] += src[i] * weight;
+         row_max = (std::max)(row_max, dst[i]);
+      }
+      return row_max;
+#endif
+   }
+
+   // Rounded division by 255, exact for x in [0, 65535]: equals (x + 127) / 255
+   constexpr uint32_t div255(uint32_t x) noexcept
+   {
+      x += 128;
+      return (x + (x >> 8)) >> 8;
+   }
+
+   // Blends a solid color over n RGBA pixels using per pixel coverage values
+   // rgb = (dst * (255 - a) + color * a) / 255 rounded, alpha saturates at dst_alpha + a
+   inline void blend_row(uint8_t* dst, const uint8_t* coverage, size_t n, uint8_t r, uint8_t g, uint8_t b) noexcept
+   {
+      size_t i = 0;
+
+#if defined(PLOTZ_SSE2)
+      {
+         const __m128i zero = _mm_setzero_si128();
+         const __m128i v255 = _mm_set1_epi16(255);
+         const __m128i v128 = _mm_set1_epi16(128);
+         const __m128i color = _mm_setr_epi16(r, g, b, 0, r, g, b, 0);
+         const __m128i alpha_mask = _mm_set1_epi32(int(0xFF000000u));
+         for (; i + 4 <= n; i += 4) {
+            int32_t cov4;
+            std::memcpy(&cov4, coverage + i, 4);
+            // Replicate each coverage byte across its pixel's four channels
+            __m128i a = _mm_cvtsi32_si128(cov4);
+            a = _mm_unpacklo_epi8(a, a);
+            a = _mm_unpacklo_epi16(a, a);
+
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+
+            auto blend_half = [&](__m128i d16, __m128i a16) {
+               const __m128i inv = _mm_sub_epi16(v255, a16);
+               __m128i x = _mm_add_epi16(_mm_mullo_epi16(d16, inv), _mm_mullo_epi16(color, a16));
+               x = _mm_add_epi16(x, v128);
+               return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+            };
+            const __m128i lo = blend_half(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(a, zero));
+            const __m128i hi = blend_half(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(a, zero));
+            const __m128i rgb = _mm_packus_epi16(lo, hi);
+            const __m128i alpha = _mm_adds_epu8(d, a);
+
+            const __m128i out = _mm_or_si128(_mm_andnot_si128(alpha_mask, rgb), _mm_and_si128(alpha_mask, alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), out);
+         }
+      }
+#elif defined(__ARM_NEON)
+      {
+         const uint8x8_t vr = vdup_n_u8(r);
+         const uint8x8_t vg = vdup_n_u8(g);
+         const uint8x8_t vb = vdup_n_u8(b);
+         const uint16x8_t v128 = vdupq_n_u16(128);
+         auto blend_channel = [&](uint8x8_t d, uint8x8_t c, uint8x8_t a, uint8x8_t inv) {
+            uint16x8_t x = vmlal_u8(vmull_u8(d, inv), c, a);
+            x = vaddq_u16(x, v128);
+            return vshrn_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
+         };
+         for (; i + 8 <= n; i += 8) {
+            uint8x8x4_t px = vld4_u8(dst + i * 4);
+            const uint8x8_t a = vld1_u8(coverage + i);
+            const uint8x8_t inv = vmvn_u8(a);
+            px.val[0] = blend_channel(px.val[0], vr, a, inv);
+            px.val[1] = blend_channel(px.val[1], vg, a, inv);
+            px.val[2] = blend_channel(px.val[2], vb, a, inv);
+            px.val[3] = vqadd_u8(px.val[3], a);
+            vst4_u8(dst + i * 4, px);
+         }
+      }
+#endif
+
+      for (; i < n; ++i) {
+         const uint32_t a = coverage[i];
+         const uint32_t inv = 255 - a;
+         uint8_t* pixel = dst + i * 4;
+         pixel[0] = uint8_t(div255(pixel[0] * inv + r * a));
+         pixel[1] = uint8_t(div255(pixel[1] * inv + g * a));
+         pixel[2] = uint8_t(div255(pixel[2] * inv + b * a));
+         pixel[3] = uint8_t((std::min)(255u, pixel[3] + a));
+      }
+   }
+}
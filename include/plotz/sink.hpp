@@ -0,0 +1,48 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace plotz
+{
+   // Receives encoded bytes in order as they are produced, e.g. to send them straight into a socket
+   // May throw, encoders stop and rethrow the exception
+   using write_callback = std::function<void(const uint8_t* data, size_t size)>;
+
+   // Growable in-memory output
+   // clear() keeps the capacity, so one sink reused across frames stops allocating once it has grown to the
+   // frame size. Reserve bytes up front to encode into a pre-sized arena.
+   struct memory_sink final
+   {
+      std::vector<uint8_t> bytes;
+
+      void clear() noexcept { bytes.clear(); }
+
+      void write(const uint8_t* data, size_t size) { bytes.insert(bytes.end(), data, data + size); }
+
+      // Callback appending to this sink, the sink must outlive the callback
+      write_callback callback()
+      {
+         return [this](const uint8_t* data, size_t size) { write(data, size); };
+      }
+   };
+
+   // Callback writing to an open file
+   inline write_callback file_callback(FILE* fp)
+   {
+      return [fp](const uint8_t* data, size_t size) {
+         if (fwrite(data, 1, size, fp) != size) {
+            throw std::runtime_error(std::format("Error writing file: {}", std::strerror(errno)));
+         }
+      };
+   }
+}
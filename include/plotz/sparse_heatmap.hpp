@@ -0,0 +1,243 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "plotz/color_scheme.hpp"
+#include "plotz/colorize.hpp"
+#include "plotz/heatmap.hpp"
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/simd.hpp"
+
+namespace plotz
+{
+   // Recycles fixed size float tiles, so clearing and refilling a sparse heatmap does not allocate
+   struct tile_pool final
+   {
+      explicit tile_pool(size_t tile_values_in) noexcept : tile_values(tile_values_in) {}
+
+      // Returns a zeroed tile
+      float* acquire()
+      {
+         if (free_tiles.empty()) {
+            storage.emplace_back(new float[tile_values]());
+            PLOTZ_COUNT_ALLOCATED(tile_values * sizeof(float));
+            return storage.back().get();
+         }
+         float* tile = free_tiles.back();
+         free_tiles.pop_back();
+         return tile;
+      }
+
+      void release(float* tile)
+      {
+         std::fill_n(tile, tile_values, 0.0f);
+         free_tiles.push_back(tile);
+      }
+
+      size_t allocated() const noexcept { return storage.size(); }
+
+     private:
+      size_t tile_values{};
+      std::vector<std::unique_ptr<float[]>> storage;
+      std::vector<float*> free_tiles;
+   };
+
+   // Heatmap for huge, mostly empty areas
+   // The plane is divided into tile_size x tile_size tiles that are only allocated on first write, so memory
+   // follows the touched area instead of width * height. Rendering fills untouched tiles with the background
+   // color (the color of 0) without reading any data.
+   struct sparse_heatmap final
+   {
+      static constexpr uint32_t tile_size = 256;
+
+      sparse_heatmap(uint32_t width_in, uint32_t height_in)
+         : width(width_in),
+           height(height_in),
+           tiles_x((width_in + tile_size - 1) / tile_size),
+           tiles_y((height_in + tile_size - 1) / tile_size),
+           tiles(size_t(tiles_x) * tiles_y)
+      {}
+
+      sparse_heatmap(const sparse_heatmap&) = delete;
+      sparse_heatmap(sparse_heatmap&&) noexcept = default;
+      sparse_heatmap& operator=(const sparse_heatmap&) = delete;
+      sparse_heatmap& operator=(sparse_heatmap&&) noexcept = default;
+
+      uint32_t width{}, height{}; // Dimensions
+      uint32_t tiles_x{}, tiles_y{}; // Tile grid dimensions
+      float max_heat{}; // Maximum heat value
+
+      // Tile holding (x, y), nullptr when the tile was never written
+      const float* tile(uint32_t tx, uint32_t ty) const noexcept { return tiles[size_t(ty) * tiles_x + tx]; }
+
+      float value(uint32_t x, uint32_t y) const noexcept
+      {
+         const float* t = tile(x / tile_size, y / tile_size);
+         return t ? t[(y % tile_size) * tile_size + x % tile_size] : 0.0f;
+      }
+
+      // Number of allocated tiles
+      size_t touched_tiles() const noexcept { return touched; }
+
+      // Releases all tiles to the pool and resets the heat
+      void clear()
+      {
+         for (auto& t : tiles) {
+            if (t) {
+               pool.release(t);
+               t = nullptr;
+            }
+         }
+         touched = 0;
+         max_heat = 0.0f;
+      }
+
+      void add_point(uint32_t x, uint32_t y) { add_point_with_stamp(x, y, default_fixed_stamp); }
+
+      void add_point_with_stamp(uint32_t x, uint32_t y, const heatmap_stamp& stamp) { add_stamp(x, y, 1.0f, stamp); }
+
+      template <uint32_t R>
+      void add_point_with_stamp(uint32_t x, uint32_t y, const fixed_stamp<R>& stamp)
+      {
+         add_stamp(x, y, 1.0f, stamp);
+      }
+
+      void add_weighted_point(uint32_t x, uint32_t y, float weight)
+      {
+         add_weighted_point_with_stamp(x, y, weight, default_fixed_stamp);
+      }
+
+      void add_weighted_point_with_stamp(uint32_t x, uint32_t y, float weight, const heatmap_stamp& stamp)
+      {
+         add_stamp(x, y, weight, stamp);
+      }
+
+      template <uint32_t R>
+      void add_weighted_point_with_stamp(uint32_t x, uint32_t y, float weight, const fixed_stamp<R>& stamp)
+      {
+         add_stamp(x, y, weight, stamp);
+      }
+
+      void add_points(std::span<const point> points)
+      {
+         for (const auto& p : points) add_stamp(p.x, p.y, 1.0f, default_fixed_stamp);
+      }
+
+      void add_weighted_points(std::span<const weighted_point> points)
+      {
+         for (const auto& p : points) add_stamp(p.x, p.y, p.weight, default_fixed_stamp);
+      }
+
+      // Renders the region with its top left corner at (x0, y0) into out, the region must lie inside the heatmap
+      void render_into(const image_view& out, uint32_t x0 = 0, uint32_t y0 = 0) const
+      {
+         render_into(out, x0, y0, default_color_scheme);
+      }
+
+      void render_into(const image_view& out, uint32_t x0, uint32_t y0, const auto& colors) const
+      {
+         float saturation = max_heat > 0.0f ? max_heat : 1.0f;
+         render_saturated_into(out, x0, y0, colors, saturation);
+      }
+
+      void render_saturated_into(const image_view& out, uint32_t x0, uint32_t y0, const auto& colors,
+                                 float saturation) const
+      {
+         render_saturated_into(out, x0, y0, palette(colors), saturation);
+      }
+
+      void render_saturated_into(const image_view& out, uint32_t x0, uint32_t y0, const palette& colors,
+                                 float saturation) const
+      {
+         assert(saturation > 0.0f);
+         assert(uint64_t(x0) + out.width <= width && uint64_t(y0) + out.height <= height);
+         PLOTZ_SCOPE(render, "sparse_heatmap::render_saturated_into");
+
+         const float scale = 1.0f / saturation;
+         static constexpr float zero = 0.0f;
+         uint8_t background[4];
+         colorize(&zero, 1, 0.0f, scale, colors, background);
+
+         for (uint32_t y = 0; y < out.height; ++y) {
+            const uint32_t src_y = y0 + y;
+            const uint32_t ty = src_y / tile_size;
+            uint8_t* dst = out.row(y);
+            for (uint32_t x = 0; x < out.width;) {
+               const uint32_t src_x = x0 + x;
+               const uint32_t tx = src_x / tile_size;
+               const uint32_t n = (std::min)(out.width - x, (tx + 1) * tile_size - src_x);
+               if (const float* t = tile(tx, ty)) {
+                  colorize(t + (src_y % tile_size) * tile_size + src_x % tile_size, n, 0.0f, scale, colors,
+                           dst + size_t(x) * 4);
+               }
+               else {
+                  for (uint32_t i = 0; i < n; ++i) std::memcpy(dst + size_t(x + i) * 4, background, 4);
+               }
+               x += n;
+            }
+         }
+      }
+
+     private:
+      std::vector<float*> tiles; // tiles_x * tiles_y, row major
+      size_t touched{};
+      tile_pool pool{size_t(tile_size) * tile_size};
+
+      float* tile_for_write(uint32_t tx, uint32_t ty)
+      {
+         float*& t = tiles[size_t(ty) * tiles_x + tx];
+         if (!t) {
+            t = pool.acquire();
+            ++touched;
+         }
+         return t;
+      }
+
+      // Adds the stamp centered at (x, y), splitting each stamp row at tile boundaries
+      template <class Stamp>
+      void add_stamp(uint32_t x, uint32_t y, float weight, const Stamp& stamp)
+      {
+         if (x >= width || y >= height || weight < 0.0f) return;
+         PLOTZ_COUNT_POINTS(1);
+
+         const uint32_t half_w = stamp.get_width() / 2;
+         const uint32_t half_h = stamp.get_height() / 2;
+         const uint32_t stamp_stride = stamp.get_stride();
+         const float* stamp_buf = stamp.get_data();
+
+         // Heatmap rectangle [x - half_w, x - half_w + stamp width) covered by the stamp, clipped to the heatmap
+         // like basic_heatmap::accumulate_stamp, so even sized stamps cover exactly their own columns and rows
+         const uint32_t left = x > half_w ? x - half_w : 0;
+         const uint32_t top = y > half_h ? y - half_h : 0;
+         const uint32_t right = (std::min)(width, x + (stamp.get_width() - half_w));
+         const uint32_t bottom = (std::min)(height, y + (stamp.get_height() - half_h));
+
+         float touched_max = max_heat;
+         for (uint32_t iy = top; iy < bottom; ++iy) {
+            const float* stamp_row = stamp_buf + size_t(iy + half_h - y) * stamp_stride + (left + half_w - x);
+            const uint32_t ty = iy / tile_size;
+            const uint32_t row_offset = (iy % tile_size) * tile_size;
+            for (uint32_t ix = left; ix < right;) {
+               const uint32_t tx = ix / tile_size;
+               const uint32_t n = (std::min)(right, (tx + 1) * tile_size) - ix;
+               float* dst = tile_for_write(tx, ty) + row_offset + ix % tile_size;
+               const float row_max = simd::accumulate_row(dst, stamp_row + (ix - left), weight, n);
+               touched_max = (std::max)(touched_max, row_max);
+               ix += n;
+            }
+         }
+         max_heat = touched_max;
+      }
+   };
+}
@@ -4,56 +4,304 @@
 #pragma once
 
 #include <png.h>
+#include <zlib.h>
 
+#include <cerrno>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <format>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "plotz/colorize.hpp"
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/sink.hpp"
+
 namespace plotz
 {
-   inline void write_png(const std::string& filename, const uint8_t* data, size_t w, size_t h)
+   // Encoder settings, -1 keeps the libpng default
+   struct png_options final
+   {
+      int compression_level = -1; // zlib level, 0 (store) to 9 (smallest), e.g. 1 for fast previews
+      int compression_strategy = -1; // Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE or Z_FIXED
+      int filters = -1; // Bitwise or of PNG_FILTER_NONE, PNG_FILTER_SUB, ..., or PNG_ALL_FILTERS
+   };
+
+   // Streaming RGBA PNG writer
+   // Rows are compressed as they are written, so an image can be encoded band by band while it is being rendered.
+   // Output goes to a file or to any write_callback (memory, sockets, arenas).
+   // Writers constructed with a palette of up to 256 colors write indexed PNGs instead: rows hold one palette index
+   // per pixel and the palette is stored in the PLTE chunk, with a tRNS chunk when any color is translucent.
+   // Call finish() after the last row, an unfinished writer leaves incomplete output when destroyed.
+   struct png_writer final
    {
-      png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-      if (!png_ptr) {
-         throw std::runtime_error("Error initializing libpng write struct.");
+      png_writer(const std::string& filename, uint32_t width_in, uint32_t height_in, const png_options& options = {})
+         : width(width_in),
+           height(height_in)
+      {
+         open(filename);
+         init(options, nullptr);
       }
 
-      png_infop info_ptr = png_create_info_struct(png_ptr);
-      if (!info_ptr) {
-         png_destroy_write_struct(&png_ptr, nullptr);
-         throw std::runtime_error("Error initializing libpng info struct.");
+      png_writer(write_callback sink_in, uint32_t width_in, uint32_t height_in, const png_options& options = {})
+         : width(width_in),
+           height(height_in),
+           sink(std::move(sink_in))
+      {
+         init(options, nullptr);
       }
 
-      if (setjmp(png_jmpbuf(png_ptr))) {
-         png_destroy_write_struct(&png_ptr, &info_ptr);
-         throw std::runtime_error("Error during PNG creation.");
+      // Indexed color output
+      png_writer(const std::string& filename, uint32_t width_in, uint32_t height_in, const palette& colors,
+                 const png_options& options = {})
+         : width(width_in),
+           height(height_in),
+           bytes_per_pixel(1)
+      {
+         open(filename);
+         init(options, &colors);
+      }
+
+      png_writer(write_callback sink_in, uint32_t width_in, uint32_t height_in, const palette& colors,
+                 const png_options& options = {})
+         : width(width_in),
+           height(height_in),
+           bytes_per_pixel(1),
+           sink(std::move(sink_in))
+      {
+         init(options, &colors);
+      }
+
+      png_writer(const png_writer&) = delete;
+      png_writer& operator=(const png_writer&) = delete;
+
+      ~png_writer() { destroy(); }
+
+      // Writes the next `count` rows of width * 4 bytes (width indices when indexed), each `stride` bytes apart (0 for
+      // packed rows)
+      void write_rows(const uint8_t* rows, uint32_t count, size_t stride = 0)
+      {
+         if (!png_ptr) {
+            throw std::runtime_error("PNG writer is closed.");
+         }
+         if (count > height - rows_written) {
+            throw std::runtime_error("Too many rows written to PNG.");
+         }
+         const size_t row_stride = stride ? stride : size_t(width) * bytes_per_pixel;
+         PLOTZ_SCOPE(encode, "png_writer::write_rows");
+
+         for (uint32_t y = 0; y < count; ++y) write_row(rows + y * row_stride);
+         rows_written += count;
       }
 
-      std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(filename.c_str(), "wb"), &fclose);
-      if (!fp) {
-         png_destroy_write_struct(&png_ptr, &info_ptr);
-         throw std::runtime_error(std::format("Error writing {}: {}", filename, std::strerror(errno)));
+      // Writes a band of rows, band.width must match the image width
+      void write_rows(const image_view& band)
+      {
+         if (band.width != width) {
+            throw std::runtime_error("PNG row band width mismatch.");
+         }
+         if (bytes_per_pixel != 4) {
+            throw std::runtime_error("RGBA rows written to an indexed PNG.");
+         }
+         write_rows(band.data, band.height, band.stride);
       }
-      png_init_io(png_ptr, fp.get());
 
-      // Set PNG header information.
-      static constexpr int bit_depth = 8;
-      static constexpr int color_type = PNG_COLOR_TYPE_RGB_ALPHA;
-      static constexpr int interlace_type = PNG_INTERLACE_NONE;
-      png_set_IHDR(png_ptr, info_ptr, static_cast<png_uint_32>(w), static_cast<png_uint_32>(h), bit_depth, color_type,
-                   interlace_type, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+      // Completes the PNG stream once all rows have been written, closing the file when writing to one
+      void finish()
+      {
+         if (!png_ptr) {
+            throw std::runtime_error("PNG writer is closed.");
+         }
+         if (rows_written != height) {
+            throw std::runtime_error("Not all PNG rows written.");
+         }
+         PLOTZ_SCOPE(encode, "png_writer::finish");
 
-      auto row_pointers = std::make_unique_for_overwrite<png_bytep[]>(h);
-      for (size_t y = 0; y < h; ++y) {
-         row_pointers[y] = const_cast<png_bytep>(data + y * w * 4);
+         if (setjmp(png_jmpbuf(png_ptr))) {
+            fail();
+         }
+
+         png_write_end(png_ptr, nullptr);
+         destroy();
+
+         if (fp && fclose(fp.release()) != 0) {
+            throw std::runtime_error(std::format("Error closing PNG file: {}", std::strerror(errno)));
+         }
       }
-      png_set_rows(png_ptr, info_ptr, row_pointers.get());
 
-      // Write the PNG image data.
-      png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, nullptr);
+     private:
+      uint32_t width{}, height{};
+      uint32_t bytes_per_pixel = 4; // 1 for indexed color
+      uint32_t rows_written{};
+      png_structp png_ptr{};
+      png_infop info_ptr{};
+      std::unique_ptr<FILE, decltype(&fclose)> fp{nullptr, &fclose};
+      write_callback sink;
+      std::exception_ptr sink_error; // Exception thrown by the sink while inside libpng
 
-      png_destroy_write_struct(&png_ptr, &info_ptr);
+      void open(const std::string& filename)
+      {
+         fp.reset(fopen(filename.c_str(), "wb"));
+         if (!fp) {
+            throw std::runtime_error(std::format("Error writing {}: {}", filename, std::strerror(errno)));
+         }
+         sink = file_callback(fp.get());
+      }
+
+      // colors selects indexed output when not null
+      void init(const png_options& options, const palette* colors)
+      {
+         // PLTE and tRNS entries, filled before the setjmp below so no destructors are skipped by longjmp
+         std::vector<png_color> plte;
+         std::vector<png_byte> trns;
+         if (colors) {
+            if (colors->empty() || colors->size() > 256) {
+               throw std::runtime_error(std::format("Indexed PNG needs 1 to 256 colors, got {}.", colors->size()));
+            }
+            plte.resize(colors->size());
+            trns.resize(colors->size());
+            size_t opaque_tail = colors->size(); // tRNS may omit trailing opaque entries
+            for (size_t i = 0; i < colors->size(); ++i) {
+               uint8_t c[4];
+               std::memcpy(c, &colors->colors[i], 4);
+               plte[i] = {c[0], c[1], c[2]};
+               trns[i] = c[3];
+            }
+            while (opaque_tail > 0 && trns[opaque_tail - 1] == 255) --opaque_tail;
+            trns.resize(opaque_tail);
+         }
+
+         png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+         if (!png_ptr) {
+            throw std::runtime_error("Error initializing libpng write struct.");
+         }
+
+         info_ptr = png_create_info_struct(png_ptr);
+         if (!info_ptr) {
+            destroy();
+            throw std::runtime_error("Error initializing libpng info struct.");
+         }
+
+         if (setjmp(png_jmpbuf(png_ptr))) {
+            fail();
+         }
+
+         png_set_write_fn(png_ptr, this, &png_writer::write_data, &png_writer::flush_data);
+
+         if (options.compression_level >= 0) png_set_compression_level(png_ptr, options.compression_level);
+         if (options.compression_strategy >= 0) png_set_compression_strategy(png_ptr, options.compression_strategy);
+         if (options.filters >= 0) png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, options.filters);
+
+         // Set PNG header information.
+         static constexpr int bit_depth = 8;
+         const int color_type = colors ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGB_ALPHA;
+         static constexpr int interlace_type = PNG_INTERLACE_NONE;
+         png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, color_type, interlace_type,
+                      PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+         if (colors) {
+            png_set_PLTE(png_ptr, info_ptr, plte.data(), int(plte.size()));
+            if (!trns.empty()) png_set_tRNS(png_ptr, info_ptr, trns.data(), int(trns.size()), nullptr);
+         }
+
+         png_write_info(png_ptr, info_ptr);
+      }
+
+      // The only libpng call of write_rows, kept apart so no caller locals are live across the setjmp
+      void write_row(const uint8_t* row)
+      {
+         if (setjmp(png_jmpbuf(png_ptr))) {
+            fail();
+         }
+         png_write_row(png_ptr, row);
+      }
+
+      static void write_data(png_structp png, png_bytep data, png_size_t length)
+      {
+         auto* self = static_cast<png_writer*>(png_get_io_ptr(png));
+         try {
+            self->sink(data, length);
+            PLOTZ_COUNT_ENCODED(length);
+         }
+         catch (...) {
+            self->sink_error = std::current_exception();
+         }
+         // Leave the catch block before unwinding through libpng
+         if (self->sink_error) png_error(png, "PNG sink error");
+      }
+
+      static void flush_data(png_structp) {}
+
+      [[noreturn]] void fail()
+      {
+         destroy();
+         if (sink_error) std::rethrow_exception(std::exchange(sink_error, nullptr));
+         throw std::runtime_error("Error during PNG creation.");
+      }
+
+      void destroy() noexcept
+      {
+         if (png_ptr) {
+            png_destroy_write_struct(&png_ptr, info_ptr ? &info_ptr : nullptr);
+            png_ptr = nullptr;
+            info_ptr = nullptr;
+         }
+      }
+   };
+
+   inline void write_png(const std::string& filename, const image_view& image, const png_options& options = {})
+   {
+      png_writer writer(filename, image.width, image.height, options);
+      writer.write_rows(image);
+      writer.finish();
+   }
+
+   // Encodes into any callback, e.g. a socket writer
+   inline void write_png(const write_callback& sink, const image_view& image, const png_options& options = {})
+   {
+      png_writer writer(sink, image.width, image.height, options);
+      writer.write_rows(image);
+      writer.finish();
+   }
+
+   // Encodes into memory, appending to the sink
+   inline void write_png(memory_sink& sink, const image_view& image, const png_options& options = {})
+   {
+      write_png(sink.callback(), image, options);
+   }
+
+   inline void write_png(const std::string& filename, const uint8_t* data, size_t w, size_t h,
+                         const png_options& options = {})
+   {
+      write_png(filename, image_view(const_cast<uint8_t*>(data), uint32_t(w), uint32_t(h)), options);
+   }
+
+   // Indexed color PNGs from width x height palette indices, e.g. produced by heatmap::render_indices
+   // colors must hold at most 256 entries, see indexed_palette
+   inline void write_png_indexed(const std::string& filename, const uint8_t* indices, uint32_t width, uint32_t height,
+                                 const palette& colors, const png_options& options = {})
+   {
+      png_writer writer(filename, width, height, colors, options);
+      writer.write_rows(indices, height);
+      writer.finish();
+   }
+
+   inline void write_png_indexed(const write_callback& sink, const uint8_t* indices, uint32_t width, uint32_t height,
+                                 const palette& colors, const png_options& options = {})
+   {
+      png_writer writer(sink, width, height, colors, options);
+      writer.write_rows(indices, height);
+      writer.finish();
+   }
+
+   inline void write_png_indexed(memory_sink& sink, const uint8_t* indices, uint32_t width, uint32_t height,
+                                 const palette& colors, const png_options& options = {})
+   {
+      write_png_indexed(sink.callback(), indices, width, height, colors, options);
    }
 }
@@ -0,0 +1,296 @@
+// Plotz Library
+// For the license information refer to plotz.hpp
+
+#pragma once
+
+#include <png.h>
+#include <zlib.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "plotz/image.hpp"
+#include "plotz/instrument.hpp"
+#include "plotz/parallel.hpp"
+#include "plotz/sink.hpp"
+#include "plotz/write_png.hpp"
+
+namespace plotz
+{
+   namespace detail
+   {
+      inline void store_be32(uint8_t* out, uint32_t v) noexcept
+      {
+         out[0] = uint8_t(v >> 24);
+         out[1] = uint8_t(v >> 16);
+         out[2] = uint8_t(v >> 8);
+         out[3] = uint8_t(v);
+      }
+
+      inline uint8_t paeth_predictor(int a, int b, int c) noexcept
+      {
+         const int p = a + b - c;
+         const int pa = std::abs(p - a);
+         const int pb = std::abs(p - b);
+         const int pc = std::abs(p - c);
+         if (pa <= pb && pa <= pc) return uint8_t(a);
+         if (pb <= pc) return uint8_t(b);
+         return uint8_t(c);
+      }
+
+      // Applies PNG filter type `filter` (PNG_FILTER_VALUE_*) to an RGBA row, prev is nullptr for the first row
+      inline void filter_row(uint8_t filter, const uint8_t* row, const uint8_t* prev, size_t n, uint8_t* out) noexcept
+      {
+         static constexpr size_t bpp = 4;
+         const size_t head = (std::min)(bpp, n);
+
+         if (!prev) {
+            // Without a previous row Up is None, Avg uses a / 2 and Paeth reduces to Sub
+            switch (filter) {
+            case PNG_FILTER_VALUE_SUB:
+            case PNG_FILTER_VALUE_PAETH:
+               std::memcpy(out, row, head);
+               for (size_t i = bpp; i < n; ++i) out[i] = uint8_t(row[i] - row[i - bpp]);
+               return;
+            case PNG_FILTER_VALUE_AVG:
+               std::memcpy(out, row, head);
+               for (size_t i = bpp; i < n; ++i) out[i] = uint8_t(row[i] - (row[i - bpp] >> 1));
+               return;
+            default:
+               std::memcpy(out, row, n);
+               return;
+            }
+         }
+
+         switch (filter) {
+         case PNG_FILTER_VALUE_SUB:
+            std::memcpy(out, row, head);
+            for (size_t i = bpp; i < n; ++i) out[i] = uint8_t(row[i] - row[i - bpp]);
+            return;
+         case PNG_FILTER_VALUE_UP:
+            for (size_t i = 0; i < n; ++i) out[i] = uint8_t(row[i] - prev[i]);
+            return;
+         case PNG_FILTER_VALUE_AVG:
+            for (size_t i = 0; i < head; ++i) out[i] = uint8_t(row[i] - (prev[i] >> 1));
+            for (size_t i = bpp; i < n; ++i) out[i] = uint8_t(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+            return;
+         case PNG_FILTER_VALUE_PAETH:
+            for (size_t i = 0; i < head; ++i) out[i] = uint8_t(row[i] - prev[i]);
+            for (size_t i = bpp; i < n; ++i) {
+               out[i] = uint8_t(row[i] - paeth_predictor(row[i - bpp], prev[i], prev[i - bpp]));
+            }
+            return;
+         default:
+            std::memcpy(out, row, n);
+            return;
+         }
+      }
+
+      // Filters a row with the allowed filter (PNG_FILTER_* mask) that minimizes the sum of absolute differences,
+      // the same heuristic libpng uses. Writes the filter byte followed by the filtered row.
+      inline void filter_row_adaptive(int filters, const uint8_t* row, const uint8_t* prev, size_t n, uint8_t* out,
+                                      uint8_t* scratch)
+      {
+         static constexpr std::array<std::pair<int, uint8_t>, 5> candidates{{
+            {PNG_FILTER_NONE, PNG_FILTER_VALUE_NONE},
+            {PNG_FILTER_SUB, PNG_FILTER_VALUE_SUB},
+            {PNG_FILTER_UP, PNG_FILTER_VALUE_UP},
+            {PNG_FILTER_AVG, PNG_FILTER_VALUE_AVG},
+            {PNG_FILTER_PAETH, PNG_FILTER_VALUE_PAETH},
+         }};
+
+         uint64_t best_sum = UINT64_MAX;
+         for (const auto& [mask, value] : candidates) {
+            if (!(filters & mask)) continue;
+            if (filters == mask) {
+               // Only one filter allowed, nothing to compare
+               out[0] = value;
+               filter_row(value, row, prev, n, out + 1);
+               return;
+            }
+            filter_row(value, row, prev, n, scratch);
+            uint64_t sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+               sum += uint64_t(std::abs(int(int8_t(scratch[i]))));
+            }
+
+            if (sum < best_sum) {
+               best_sum = sum;
+               out[0] = value;
+               std::memcpy(out + 1, scratch, n);
+            }
+         }
+      }
+
+      inline void write_png_chunk(const write_callback& sink, const char* type, const uint8_t* data, size_t size)
+      {
+         uint8_t header[8];
+         store_be32(header, uint32_t(size));
+         std::memcpy(header + 4, type, 4);
+         uLong crc = crc32(0, header + 4, 4);
+         if (size) crc = crc32(crc, data, uInt(size));
+         uint8_t footer[4];
+         store_be32(footer, uint32_t(crc));
+
+         sink(header, 8);
+         if (size) sink(data, size);
+         sink(footer, 4);
+         PLOTZ_COUNT_ENCODED(size + 12);
+      }
+
+      struct png_strip final
+      {
+         std::vector<uint8_t> compressed;
+         uLong adler = adler32(0, nullptr, 0);
+         size_t filtered_size{};
+      };
+   }
+
+   // Encodes an RGBA image as PNG using several threads
+   // The image is split into horizontal strips that are filtered and deflated independently. Every strip but the
+   // last ends with a sync flush, so the raw deflate streams concatenate into one valid zlib stream whose checksum
+   // is combined from the per strip Adler-32 values. Output is a standard PNG, slightly larger than a serial
+   // encode because each strip starts with an empty dictionary.
+   // options.filters follows png_writer (-1 means adaptive over all filters), threads == 0 uses
+   // default_thread_count()
+   inline void write_png_parallel(const write_callback& sink, const image_view& image,
+                                  const png_options& options = {}, size_t threads = 0)
+   {
+      if (image.width == 0 || image.height == 0) {
+         throw std::runtime_error("PNG images must have non-zero dimensions.");
+      }
+      if (threads == 0) threads = default_thread_count();
+      PLOTZ_SCOPE(encode, "write_png_parallel");
+
+      const size_t row_bytes = size_t(image.width) * 4;
+      const int level = options.compression_level >= 0 ? options.compression_level : Z_DEFAULT_COMPRESSION;
+      const int filters = options.filters >= 0 ? options.filters : PNG_ALL_FILTERS;
+      // Match libpng, which prefers Z_FILTERED whenever rows are filtered
+      const int strategy = options.compression_strategy >= 0 ? options.compression_strategy
+                           : (filters == PNG_FILTER_NONE) ? Z_DEFAULT_STRATEGY
+                                                          : Z_FILTERED;
+
+      // Small strips compress poorly, keep at least 32 rows per strip
+      // Strips are also capped at 256 MiB of filtered data, so zlib's 32 bit lengths never overflow
+      static constexpr uint32_t min_strip_rows = 32;
+      static constexpr size_t max_strip_bytes = size_t(1) << 28;
+      const size_t image_bytes = size_t(image.height) * (row_bytes + 1);
+      const size_t strip_count = (std::max)(
+         (std::max<size_t>)(1, (std::min<size_t>)(threads, (image.height + min_strip_rows - 1) / min_strip_rows)),
+         (image_bytes + max_strip_bytes - 1) / max_strip_bytes);
+      const uint32_t strip_rows = uint32_t((image.height + strip_count - 1) / strip_count);
+
+      std::vector<detail::png_strip> strips(strip_count);
+      parallel_for(strip_count, threads, [&](size_t strip_begin, size_t strip_end) {
+         std::vector<uint8_t> filtered;
+         std::vector<uint8_t> scratch(row_bytes);
+         for (size_t s = strip_begin; s < strip_end; ++s) {
+            const uint32_t y0 = uint32_t(s) * strip_rows;
+            const uint32_t y1 = (std::min)(image.height, y0 + strip_rows);
+
+            filtered.resize((y1 - y0) * (row_bytes + 1));
+            uint8_t* out = filtered.data();
+            for (uint32_t y = y0; y < y1; ++y, out += row_bytes + 1) {
+               const uint8_t* prev = y > 0 ? image.row(y - 1) : nullptr;
+               detail::filter_row_adaptive(filters, image.row(y), prev, row_bytes, out, scratch.data());
+            }
+
+            auto& strip = strips[s];
+            strip.filtered_size = filtered.size();
+            strip.adler = adler32(strip.adler, filtered.data(), uInt(filtered.size()));
+
+            z_stream zs{};
+            if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+               throw std::runtime_error("Error initializing zlib deflate.");
+            }
+            strip.compressed.resize(deflateBound(&zs, uLong(filtered.size())) + 16);
+            zs.next_in = filtered.data();
+            zs.avail_in = uInt(filtered.size());
+
+            // deflateBound should leave room for everything, but a full output buffer means deflate has more to
+            // write: grow it and call again with the same flush until the strip is flushed or finished
+            const bool last = (s + 1 == strip_count);
+            int result = Z_OK;
+            while (true) {
+               zs.next_out = strip.compressed.data() + zs.total_out;
+               zs.avail_out = uInt(strip.compressed.size() - zs.total_out);
+               result = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+               if (result == Z_STREAM_ERROR) break;
+               if (last ? result == Z_STREAM_END : zs.avail_out != 0) break;
+               strip.compressed.resize(strip.compressed.size() * 2);
+            }
+            const bool ok = result != Z_STREAM_ERROR && zs.avail_in == 0;
+            const char* message = zs.msg; // zlib messages are static strings
+            strip.compressed.resize(zs.total_out);
+            deflateEnd(&zs);
+            if (!ok) {
+               throw std::runtime_error(
+                  std::format("Error during PNG compression: {}", message ? message : "zlib stream error"));
+            }
+         }
+      });
+
+      static constexpr uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+      sink(signature, 8);
+      PLOTZ_COUNT_ENCODED(8);
+
+      uint8_t ihdr[13]{};
+      detail::store_be32(ihdr, image.width);
+      detail::store_be32(ihdr + 4, image.height);
+      ihdr[8] = 8; // bit depth
+      ihdr[9] = PNG_COLOR_TYPE_RGB_ALPHA;
+      detail::write_png_chunk(sink, "IHDR", ihdr, sizeof(ihdr));
+
+      // zlib header: deflate with a 32K window, FLEVEL reflecting the compression level
+      const int flevel = (level == Z_DEFAULT_COMPRESSION || level == 6) ? 2 : level < 2 ? 0 : level < 6 ? 1 : 3;
+      uint8_t zlib_header[2] = {0x78, uint8_t(flevel << 6)};
+      zlib_header[1] = uint8_t(zlib_header[1] + (31 - (zlib_header[0] * 256 + zlib_header[1]) % 31));
+      detail::write_png_chunk(sink, "IDAT", zlib_header, 2);
+
+      uLong adler = adler32(0, nullptr, 0);
+      for (const auto& strip : strips) {
+         adler = adler32_combine(adler, strip.adler, z_off_t(strip.filtered_size));
+         // Keep IDAT chunks well under the 2^31 - 1 chunk length limit
+         static constexpr size_t max_chunk = size_t(1) << 30;
+         for (size_t offset = 0; offset < strip.compressed.size(); offset += max_chunk) {
+            const size_t n = (std::min)(max_chunk, strip.compressed.size() - offset);
+            detail::write_png_chunk(sink, "IDAT", strip.compressed.data() + offset, n);
+         }
+      }
+
+      uint8_t zlib_footer[4];
+      detail::store_be32(zlib_footer, uint32_t(adler));
+      detail::write_png_chunk(sink, "IDAT", zlib_footer, 4);
+      detail::write_png_chunk(sink, "IEND", nullptr, 0);
+   }
+
+   inline void write_png_parallel(memory_sink& sink, const image_view& image, const png_options& options = {},
+                                  size_t threads = 0)
+   {
+      write_png_parallel(sink.callback(), image, options, threads);
+   }
+
+   inline void write_png_parallel(const std::string& filename, const image_view& image,
+                                  const png_options& options = {}, size_t threads = 0)
+   {
+      std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(filename.c_str(), "wb"), &fclose);
+      if (!fp) {
+         throw std::runtime_error(std::format("Error writing {}: {}", filename, std::strerror(errno)));
+      }
+
+      write_png_parallel(file_callback(fp.get()), image, options, threads);
+
+      if (fclose(fp.release()) != 0) {
+         throw std::runtime_error(std::format("Error closing {}: {}", filename, std::strerror(errno)));
+      }
+   }
+}
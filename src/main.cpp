@@ -7,162 +7,11 @@
 #include <format>
 #include <iostream>
 #include <random>
+#include <stdexcept>
 #include <vector>
 
 #include "plotz/plotz.hpp"
 
-// Function to render text using FreeType
-inline void render_text_to_image(uint8_t* image, size_t img_width, size_t img_height, const std::string& text,
-                                 const std::string& font_filename, int font_size, int x_pos, int y_pos)
-{
-   FT_Library ft;
-   if (FT_Init_FreeType(&ft)) {
-      std::cerr << "Could not init FreeType Library\n";
-      return;
-   }
-
-   FT_Face face;
-   if (FT_New_Face(ft, font_filename.c_str(), 0, &face)) {
-      std::cerr << "Failed to load font: " << font_filename << "\n";
-      FT_Done_FreeType(ft);
-      return;
-   }
-
-   FT_Set_Pixel_Sizes(face, 0, font_size);
-
-   // Starting position
-   int pen_x = x_pos;
-   int pen_y = y_pos;
-
-   for (char c : text) {
-      // Load character glyph
-      if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-         std::cerr << "Failed to load Glyph\n";
-         continue;
-      }
-
-      FT_GlyphSlot g = face->glyph;
-
-      // For each pixel in the glyph bitmap
-      for (unsigned int row = 0; row < g->bitmap.rows; ++row) {
-         for (unsigned int col = 0; col < g->bitmap.width; ++col) {
-            int x = pen_x + g->bitmap_left + col;
-            int y = pen_y - g->bitmap_top + row;
-
-            if (x < 0 || x >= img_width || y < 0 || y >= img_height) continue;
-
-            // Calculate the pixel index in the image buffer
-            size_t pixel_index = (y * img_width + x) * 4;
-
-            // Get the value from the glyph bitmap
-            unsigned char glyph_value = g->bitmap.buffer[row * g->bitmap.width + col];
-
-            // Simple blending: assume white text, blend based on glyph_value
-            // Modify as needed for different colors or blending modes
-            unsigned char alpha = glyph_value;
-            unsigned char inv_alpha = 255 - alpha;
-
-            // Existing image pixel (RGBA)
-            unsigned char* pixel = &image[pixel_index];
-
-            // Set the pixel to white with the glyph's alpha
-            pixel[0] = (pixel[0] * inv_alpha + 255 * alpha) / 255; // R
-            pixel[1] = (pixel[1] * inv_alpha + 255 * alpha) / 255; // G
-            pixel[2] = (pixel[2] * inv_alpha + 255 * alpha) / 255; // B
-            pixel[3] = (std::min)(255, pixel[3] + alpha); // A
-         }
-      }
-
-      // Advance to the next character position
-      pen_x += g->advance.x >> 6;
-      pen_y += g->advance.y >> 6;
-   }
-
-   FT_Done_Face(face);
-   FT_Done_FreeType(ft);
-}
-
-// Function to draw the legend
-inline void draw_legend(uint8_t* image, size_t img_width, size_t img_height, size_t heatmap_width,
-                        const std::vector<uint8_t>& colors, const std::string& font_filename, int font_size)
-{
-   // Legend dimensions and margins
-   size_t legend_width = img_width - heatmap_width;
-   size_t legend_margin_top = 20;
-   size_t legend_margin_bottom = 20;
-   size_t legend_margin_left = 10;
-   size_t legend_margin_right = 10;
-
-   // Fill legend area with white background
-   for (size_t y = 0; y < img_height; ++y) {
-      for (size_t x = heatmap_width; x < img_width; ++x) {
-         unsigned char* pixel = &image[(y * img_width + x) * 4];
-         pixel[0] = 255; // R
-         pixel[1] = 255; // G
-         pixel[2] = 255; // B
-         pixel[3] = 255; // A
-      }
-   }
-
-   // Calculate the area where the legend color bar will be drawn
-   size_t legend_bar_left = heatmap_width + legend_margin_left;
-   size_t legend_bar_right = img_width - legend_margin_right;
-   size_t legend_bar_width = legend_bar_right - legend_bar_left;
-   size_t legend_bar_top = legend_margin_top;
-   size_t legend_bar_bottom = img_height - legend_margin_bottom;
-   size_t legend_bar_height = legend_bar_bottom - legend_bar_top;
-
-   size_t ncolors = plotz::get_color_count(colors);
-
-   // Draw the color bar
-   for (size_t y = 0; y < legend_bar_height; ++y) {
-      float value = static_cast<float>(legend_bar_height - y - 1) / static_cast<float>(legend_bar_height - 1);
-
-      size_t color_idx = static_cast<size_t>(value * (ncolors - 1) + 0.5f);
-      color_idx = (std::min)(color_idx, ncolors - 1);
-      const unsigned char* color = &colors[color_idx * 4];
-
-      for (size_t x = legend_bar_left; x < legend_bar_right; ++x) {
-         size_t pixel_x = x;
-         size_t pixel_y = legend_bar_top + y;
-         unsigned char* pixel = &image[(pixel_y * img_width + pixel_x) * 4];
-         pixel[0] = color[0]; // R
-         pixel[1] = color[1]; // G
-         pixel[2] = color[2]; // B
-         pixel[3] = color[3]; // A
-      }
-   }
-
-   // Add labels to the legend
-   std::string max_label = "Max";
-   std::string min_label = "Min";
-
-   // Positions for labels
-   int x_label = static_cast<int>(heatmap_width + (legend_width / 2) - (font_size * 1.5));
-   int y_max_label = static_cast<int>(legend_bar_top - 5);
-   int y_min_label = static_cast<int>(legend_bar_bottom + font_size + 5);
-
-   render_text_to_image(image, img_width, img_height, max_label, font_filename, font_size, x_label, y_max_label);
-   render_text_to_image(image, img_width, img_height, min_label, font_filename, font_size, x_label, y_min_label);
-}
-
-/*
- size_t legend_width = 124; // Width of the legend area
- size_t new_w = w + legend_width; // New image width including legend
-
- std::vector<uint8_t> new_image(new_w * h * 4, 0);
-
- // Copy data to the new image buffer
- for (size_t y = 0; y < h; ++y) {
-    const auto* src_row = &image[y * w * 4];
-    auto* dest_row = &new_image[y * new_w * 4];
-    std::memcpy(dest_row, src_row, w * 4);
- }
-
- int font_size = 14;
- draw_legend(new_image.data(), new_w, h, w, plot::default_color_scheme_data, font_filename, font_size);
- */
-
 std::vector<std::complex<float>> generateSpiral(int width, int height, int numPoints, float turns)
 {
    std::vector<std::complex<float>> data;
@@ -287,6 +136,203 @@ void heatmap_test()
    return plotz::write_png("heatmap.png", image.data(), w, h);
 }
 
+void legend_test()
+{
+   static constexpr uint32_t plot_w = 1024, legend_w = 124, h = 1024;
+
+   plotz::heatmap hm(plot_w, h);
+   for (const auto& p : generateSpiral(plot_w, h, 1000, 10)) {
+      hm.add_point(uint32_t(p.real()), uint32_t(p.imag()));
+   }
+
+   // The plot and the legend draw into their own columns of one image
+   plotz::image image(plot_w + legend_w, h);
+   const plotz::image_view out = image.view();
+   hm.render_into(out.subview(0, 0, plot_w, h));
+
+   plotz::legend_options options{};
+   options.font_filename = FONTS_DIR "/RobotoMono-SemiBold.ttf";
+   plotz::draw_legend(out.subview(plot_w, 0, legend_w, h), plotz::default_color_scheme, options);
+
+   return plotz::write_png("heatmap_legend.png", out);
+}
+
+// The sparse heatmap must accumulate exactly like the dense one, including even sized stamps at the edges and
+// across tile boundaries
+void sparse_heatmap_test()
+{
+   static constexpr uint32_t w = 600, h = 520;
+
+   std::vector<float> stamp_data(8 * 8);
+   for (size_t i = 0; i < stamp_data.size(); ++i) stamp_data[i] = float(i % 8 + i / 8 + 1) / 16.0f;
+   const plotz::heatmap_stamp stamp(8, 8, stamp_data);
+
+   plotz::heatmap dense(w, h);
+   plotz::sparse_heatmap sparse(w, h);
+   for (const auto& [x, y] : {std::pair{0u, 0u}, {w - 1, h - 1}, {255u, 256u}, {256u, 255u}, {3u, h - 4}, {300u, 2u}}) {
+      dense.add_point_with_stamp(x, y, stamp);
+      sparse.add_point_with_stamp(x, y, stamp);
+   }
+
+   for (uint32_t y = 0; y < h; ++y) {
+      for (uint32_t x = 0; x < w; ++x) {
+         if (dense.buffer[size_t(y) * w + x] != sparse.value(x, y)) {
+            throw std::runtime_error(std::format("sparse_heatmap differs from heatmap at ({}, {})", x, y));
+         }
+      }
+   }
+}
+
+// Minimal QOI decoder, enough to read back qoi_encoder output
+plotz::image decode_qoi(const std::vector<uint8_t>& in)
+{
+   if (in.size() < 22 || std::memcmp(in.data(), "qoif", 4) != 0) {
+      throw std::runtime_error("Invalid QOI header.");
+   }
+   const auto be32 = [&](size_t i) {
+      return uint32_t(in[i]) << 24 | uint32_t(in[i + 1]) << 16 | uint32_t(in[i + 2]) << 8 | uint32_t(in[i + 3]);
+   };
+   plotz::image decoded(be32(4), be32(8));
+   std::vector<uint8_t>& out = decoded.data;
+   uint8_t index[64][4]{};
+   uint8_t px[4] = {0, 0, 0, 255};
+   size_t pos = 14;
+   uint32_t run = 0;
+   for (size_t i = 0; i < out.size(); i += 4) {
+      if (run > 0) {
+         --run;
+      }
+      else {
+         if (pos >= in.size() - 8) throw std::runtime_error("Truncated QOI data.");
+         const uint8_t b1 = in[pos++];
+         if (b1 == 0xfe) {
+            std::memcpy(px, &in[pos], 3);
+            pos += 3;
+         }
+         else if (b1 == 0xff) {
+            std::memcpy(px, &in[pos], 4);
+            pos += 4;
+         }
+         else if ((b1 & 0xc0) == 0x00) {
+            std::memcpy(px, index[b1], 4);
+         }
+         else if ((b1 & 0xc0) == 0x40) {
+            px[0] += ((b1 >> 4) & 3) - 2;
+            px[1] += ((b1 >> 2) & 3) - 2;
+            px[2] += (b1 & 3) - 2;
+         }
+         else if ((b1 & 0xc0) == 0x80) {
+            const uint8_t b2 = in[pos++];
+            const int dg = (b1 & 0x3f) - 32;
+            px[0] += dg - 8 + ((b2 >> 4) & 0x0f);
+            px[1] += dg;
+            px[2] += dg - 8 + (b2 & 0x0f);
+         }
+         else {
+            run = b1 & 0x3f;
+         }
+         std::memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+      }
+      std::memcpy(&out[i], px, 4);
+   }
+
+   static constexpr uint8_t end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+   if (in.size() - pos != 8 || std::memcmp(&in[pos], end_marker, 8) != 0) {
+      throw std::runtime_error("Missing QOI end marker.");
+   }
+   return decoded;
+}
+
+// Decodes an 8 bit RGBA PNG with the libpng simplified API
+plotz::image decode_png(const std::vector<uint8_t>& in)
+{
+   png_image png{};
+   png.version = PNG_IMAGE_VERSION;
+   if (!png_image_begin_read_from_memory(&png, in.data(), in.size())) {
+      throw std::runtime_error(std::format("Error reading PNG: {}", png.message));
+   }
+   png.format = PNG_FORMAT_RGBA;
+   plotz::image decoded(png.width, png.height);
+   if (!png_image_finish_read(&png, nullptr, decoded.data.data(), 0, nullptr)) {
+      throw std::runtime_error(std::format("Error decoding PNG: {}", png.message));
+   }
+   return decoded;
+}
+
+// QOI and parallel PNG output must decode back to the source pixels, including varying alpha, noise and strip
+// boundaries that do not fall on a multiple of the strip height
+void image_writer_test()
+{
+   static constexpr uint32_t w = 517, h = 389;
+
+   plotz::heatmap hm(w, h);
+   for (const auto& p : generateSpiral(w, h, 500, 6)) {
+      hm.add_point(uint32_t(p.real()), uint32_t(p.imag()));
+   }
+   plotz::image source(w, h);
+   hm.render_into(source.view());
+
+   std::mt19937 prng(42);
+   for (uint32_t y = h / 2; y < h; ++y) {
+      uint8_t* row = source.view().row(y);
+      for (uint32_t x = 0; x < w; ++x) {
+         row[x * 4 + 3] = uint8_t(x + y);
+         if (y > 3 * h / 4) row[x * 4 + prng() % 3] = uint8_t(prng());
+      }
+   }
+
+   const auto check = [&](const plotz::image& decoded, const char* name) {
+      if (decoded.width != w || decoded.height != h || decoded.data != source.data) {
+         throw std::runtime_error(std::format("{} output does not decode to the source image", name));
+      }
+   };
+
+   plotz::memory_sink sink;
+   plotz::write_image(sink, source.view(), plotz::image_format::qoi);
+   check(decode_qoi(sink.bytes), "QOI");
+
+   for (const size_t threads : {1, 3, 8}) {
+      sink.clear();
+      plotz::write_png_parallel(sink, source.view(), {}, threads);
+      check(decode_png(sink.bytes), "Parallel PNG");
+   }
+}
+
+// band_pipeline must write the same PNG bytes as render -> render_text_to_image -> write_png, with bands that
+// split the text
+void band_pipeline_test()
+{
+   static constexpr uint32_t w = 640, h = 480;
+
+   plotz::magnitude plot(w, h);
+   for (uint32_t y = 0; y < h; ++y) {
+      for (uint32_t x = 0; x < w; ++x) {
+         plot.add_point(x, y, std::sin(float(x) * 0.05f) * std::cos(float(y) * 0.03f));
+      }
+   }
+
+   const std::string text = "Band Pipeline";
+   const std::string font_filename = FONTS_DIR "/RobotoMono-SemiBold.ttf";
+   static constexpr float font_percent = 4.f;
+
+   std::vector<uint8_t> image = plot.render();
+   plotz::render_text_to_image(image.data(), w, h, text, font_filename, font_percent);
+   plotz::memory_sink expected;
+   plotz::write_png(expected, plotz::image_view{image.data(), w, h});
+
+   plotz::band_pipeline pipeline(w, h, 7);
+   pipeline.add_text(text, font_filename, font_percent);
+   plotz::memory_sink actual;
+   plotz::png_writer writer(actual.callback(), w, h);
+   const auto [offset, scale] = plot.normalization();
+   pipeline.write_png(writer, plot.buffer.data(), offset, scale, plotz::palette(plotz::default_color_scheme));
+   writer.finish();
+
+   if (actual.bytes != expected.bytes) {
+      throw std::runtime_error("band_pipeline output differs from render_text_to_image and write_png");
+   }
+}
+
 void magnitude_test()
 {
    static constexpr size_t w = 4096, h = 4096;
@@ -300,15 +346,14 @@ void magnitude_test()
       }
    }
 
-   std::vector<uint8_t> image = plot.render();
-
    std::string text = "Sample Magnitude Plot";
    std::string font_filename = FONTS_DIR "/RobotoMono-SemiBold.ttf";
    float font_percent = 3.f;
 
-   plotz::render_text_to_image(image.data(), w, h, text, font_filename, font_percent);
-
-   return plotz::write_png("magnitude.png", image.data(), w, h);
+   // Colorize, draw the text and encode band by band, the 64 MB RGBA frame is never built
+   plotz::band_pipeline pipeline(w, h);
+   pipeline.add_text(text, font_filename, font_percent);
+   return pipeline.write_png("magnitude.png", plot);
 }
 
 void magnitude_test2()
@@ -405,6 +450,10 @@ void magnitude_mapped_shrink_test()
 int main()
 {
    heatmap_test();
+   legend_test();
+   sparse_heatmap_test();
+   image_writer_test();
+   band_pipeline_test();
    magnitude_test();
    magnitude_test2();
    magnitude_mapped_test();